@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/*Bit scans of 64-bit words. GCC and Clang builtins, MSVC intrinsics where
+the target has them and plain code elsewhere*/
+namespace bits {
+
+    //Index of the lowest set bit, the value must not be zero
+    inline int CountTrailingZeros(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(value);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index = 0;
+        _BitScanForward64(&index, value);
+        return static_cast<int>(index);
+#else
+        int result = 0;
+        while ((value & 1) == 0) {
+            value >>= 1;
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    //Index of the highest set bit, the value must not be zero
+    inline int GetMostSignificantBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(value);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index = 0;
+        _BitScanReverse64(&index, value);
+        return static_cast<int>(index);
+#else
+        int result = 0;
+        while (value >>= 1) {
+            ++result;
+        }
+        return result;
+#endif
+    }
+
+    inline int CountOnes(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(value);
+#else
+        //__popcnt64 of MSVC needs the POPCNT instruction, so bits are summed in parallel
+        value -= (value >> 1) & 0x5555555555555555ull;
+        value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+        value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+        return static_cast<int>((value * 0x0101010101010101ull) >> 56);
+#endif
+    }
+}
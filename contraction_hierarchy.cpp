@@ -0,0 +1,608 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+
+#include "contraction_hierarchy.h"
+
+namespace tg {
+
+	namespace {
+		const double INFINITE_WEIGHT = std::numeric_limits<double>::infinity();
+		//Witness searches give up after that many vertices or edges of the path, extra shortcuts are only slower
+		const size_t WITNESS_SETTLE_LIMIT = 100;
+		const uint32_t WITNESS_HOP_LIMIT = 5;
+		//Priorities are estimates, so their searches are shorter
+		const size_t PRIORITY_SETTLE_LIMIT = 50;
+		const uint32_t PRIORITY_HOP_LIMIT = 2;
+		//Contraction stops when vertices left have that many edges on average, dense graphs take cubic time
+		const double CORE_AVERAGE_DEGREE = 10;
+		const char FILE_MAGIC[8] = { 'T', 'G', 'C', 'H', '0', '0', '0', '2' };
+
+		using HeapItem = std::pair<double, uint32_t>;
+		const auto is_later = std::greater<HeapItem>();
+
+		//Neighbour in the graph that is being contracted
+		struct Arc {
+			uint32_t vertex;
+			double weight;
+			uint32_t edge;
+		};
+
+		//Bounded Dijkstra that looks for paths avoiding the contracted vertex
+		class WitnessSearch {
+		public:
+			explicit WitnessSearch(size_t vertex_count)
+				: distances_(vertex_count, INFINITE_WEIGHT)
+				, hops_(vertex_count, 0)
+				, is_target_(vertex_count, false) {
+			}
+
+			//Stops as soon as all targets are settled or further than max_weight, doesn't go beyond hop_limit edges
+			void Run(uint32_t source, uint32_t skipped, const std::vector<Arc>& targets, double max_weight,
+				const std::vector<std::vector<Arc>>& out, const std::vector<std::vector<Arc>>& in,
+				const std::vector<bool>& contracted, size_t settle_limit, uint32_t hop_limit) {
+				Clear();
+				size_t targets_left = 0;
+				for (const Arc& target : targets) {
+					//the target that is entered only from the skipped vertex can't be reached
+					const bool is_reachable = std::any_of(in[target.vertex].begin(), in[target.vertex].end(),
+						[skipped](const Arc& arc) {
+							return arc.vertex != skipped;
+						});
+					if (is_reachable && !is_target_[target.vertex] && target.vertex != source) {
+						is_target_[target.vertex] = true;
+						++targets_left;
+					}
+				}
+				distances_[source] = 0;
+				hops_[source] = 0;
+				touched_.push_back(source);
+				heap_.push_back({ 0, source });
+				size_t settled = 0;
+				while (!heap_.empty() && targets_left > 0 && settled < settle_limit) {
+					std::pop_heap(heap_.begin(), heap_.end(), is_later);
+					const auto [distance, vertex] = heap_.back();
+					heap_.pop_back();
+					if (distance > distances_[vertex]) {
+						continue;
+					}
+					if (distance > max_weight) {
+						break;
+					}
+					++settled;
+					if (is_target_[vertex]) {
+						is_target_[vertex] = false;
+						--targets_left;
+					}
+					if (hops_[vertex] == hop_limit) {
+						continue;
+					}
+					for (const Arc& arc : out[vertex]) {
+						if (arc.vertex == skipped || contracted[arc.vertex]) {
+							continue;
+						}
+						const double new_distance = distance + arc.weight;
+						if (new_distance < distances_[arc.vertex]) {
+							if (distances_[arc.vertex] == INFINITE_WEIGHT) {
+								touched_.push_back(arc.vertex);
+							}
+							distances_[arc.vertex] = new_distance;
+							hops_[arc.vertex] = hops_[vertex] + 1;
+							heap_.push_back({ new_distance, arc.vertex });
+							std::push_heap(heap_.begin(), heap_.end(), is_later);
+						}
+					}
+				}
+				for (const Arc& target : targets) {
+					is_target_[target.vertex] = false;
+				}
+			}
+
+			double GetDistance(uint32_t vertex) const {
+				return distances_[vertex];
+			}
+
+		private:
+			void Clear() {
+				for (uint32_t vertex : touched_) {
+					distances_[vertex] = INFINITE_WEIGHT;
+				}
+				touched_.clear();
+				heap_.clear();
+			}
+
+			std::vector<double> distances_;
+			std::vector<uint32_t> hops_;
+			std::vector<bool> is_target_;
+			std::vector<uint32_t> touched_;
+			std::vector<HeapItem> heap_;
+		};
+
+		template <typename Value>
+		void WriteValue(std::ostream& output, const Value& value) {
+			output.write(reinterpret_cast<const char*>(&value), sizeof(Value));
+		}
+
+		template <typename Value>
+		void WriteVector(std::ostream& output, const std::vector<Value>& values) {
+			WriteValue(output, static_cast<uint64_t>(values.size()));
+			output.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(Value));
+		}
+
+		template <typename Value>
+		bool ReadValue(std::istream& input, Value& value) {
+			return static_cast<bool>(input.read(reinterpret_cast<char*>(&value), sizeof(Value)));
+		}
+
+		template <typename Value>
+		bool ReadVector(std::istream& input, std::vector<Value>& values) {
+			uint64_t size = 0;
+			if (!ReadValue(input, size) || size > (uint64_t{ 1 } << 40) / sizeof(Value)) {
+				return false;
+			}
+			values.resize(size);
+			return static_cast<bool>(input.read(reinterpret_cast<char*>(values.data()), size * sizeof(Value)));
+		}
+	}
+
+	ContractionHierarchy ContractionHierarchy::Build(size_t vertex_count, const std::vector<InputEdge>& edges) {
+		ContractionHierarchy hierarchy;
+		hierarchy.input_edge_count_ = edges.size();
+		hierarchy.edges_.reserve(edges.size());
+		for (EdgeId id = 0; id < edges.size(); ++id) {
+			hierarchy.edges_.push_back({ edges[id].from, edges[id].to, edges[id].weight, id, NO_EDGE, NO_EDGE });
+		}
+		hierarchy.Contract(vertex_count);
+		hierarchy.BuildSearchGraphs(vertex_count);
+		return hierarchy;
+	}
+
+	uint64_t ContractionHierarchy::GetFingerprint(size_t vertex_count, const std::vector<InputEdge>& edges) {
+		//64-bit FNV-1a over the vertex count and fields of all edges
+		uint64_t hash = 14695981039346656037ull;
+		auto add_bytes = [&hash](const void* data, size_t size) {
+			const unsigned char* bytes = static_cast<const unsigned char*>(data);
+			for (size_t i = 0; i < size; ++i) {
+				hash ^= bytes[i];
+				hash *= 1099511628211ull;
+			}
+		};
+		const uint64_t count = vertex_count;
+		add_bytes(&count, sizeof(count));
+		for (const InputEdge& edge : edges) {
+			add_bytes(&edge.from, sizeof(edge.from));
+			add_bytes(&edge.to, sizeof(edge.to));
+			add_bytes(&edge.weight, sizeof(edge.weight));
+		}
+		return hash;
+	}
+
+	void ContractionHierarchy::Contract(size_t vertex_count) {
+		std::vector<std::vector<Arc>> out(vertex_count);
+		std::vector<std::vector<Arc>> in(vertex_count);
+
+		//only the lightest of parallel edges is needed
+		std::vector<EdgeId> order(edges_.size());
+		for (EdgeId id = 0; id < order.size(); ++id) {
+			order[id] = id;
+		}
+		std::sort(order.begin(), order.end(), [this](EdgeId lhs, EdgeId rhs) {
+			const Edge& l = edges_[lhs];
+			const Edge& r = edges_[rhs];
+			return std::tie(l.from, l.to, l.weight, lhs) < std::tie(r.from, r.to, r.weight, rhs);
+		});
+		for (size_t i = 0; i < order.size(); ++i) {
+			const Edge& edge = edges_[order[i]];
+			if (edge.from == edge.to) {
+				continue;
+			}
+			if (i > 0 && edges_[order[i - 1]].from == edge.from && edges_[order[i - 1]].to == edge.to) {
+				continue;
+			}
+			out[edge.from].push_back({ edge.to, edge.weight, order[i] });
+			in[edge.to].push_back({ edge.from, edge.weight, order[i] });
+		}
+
+		std::vector<bool> contracted(vertex_count, false);
+		std::vector<bool> is_stale(vertex_count, false);
+		std::vector<int> deleted_neighbours(vertex_count, 0);
+		//one more than the highest level of contracted neighbours
+		std::vector<int> levels(vertex_count, 0);
+		//number of input edges the edge stands for
+		std::vector<uint32_t> edge_hops(edges_.size(), 1);
+		WitnessSearch witness(vertex_count);
+
+		//calls add(from, to, weight, first edge, second edge) for every shortcut contraction of the vertex needs
+		auto for_each_shortcut = [&](VertexId vertex, size_t settle_limit, uint32_t hop_limit, auto add) {
+			double max_out = 0;
+			for (const Arc& arc : out[vertex]) {
+				max_out = std::max(max_out, arc.weight);
+			}
+			for (const Arc& from : in[vertex]) {
+				witness.Run(from.vertex, vertex, out[vertex], from.weight + max_out, out, in, contracted, settle_limit, hop_limit);
+				for (const Arc& to : out[vertex]) {
+					if (to.vertex == from.vertex) {
+						continue;
+					}
+					const double weight = from.weight + to.weight;
+					if (witness.GetDistance(to.vertex) > weight) {
+						add(from.vertex, to.vertex, weight, from.edge, to.edge);
+					}
+				}
+			}
+		};
+
+		/*Edge difference counts twice. Input edges behind shortcuts, deleted neighbours
+		and levels spread contraction evenly over the graph*/
+		auto get_priority = [&](VertexId vertex) {
+			int shortcuts = 0;
+			int shortcut_hops = 0;
+			for_each_shortcut(vertex, PRIORITY_SETTLE_LIMIT, PRIORITY_HOP_LIMIT,
+				[&](VertexId, VertexId, double, EdgeId first, EdgeId second) {
+				++shortcuts;
+				shortcut_hops += edge_hops[first] + edge_hops[second];
+			});
+			int removed_hops = 0;
+			for (const auto* arcs : { &in[vertex], &out[vertex] }) {
+				for (const Arc& arc : *arcs) {
+					removed_hops += edge_hops[arc.edge];
+				}
+			}
+			const int removed = static_cast<int>(in[vertex].size() + out[vertex].size());
+			return 2 * (shortcuts - removed) + shortcut_hops - removed_hops + deleted_neighbours[vertex] + levels[vertex];
+		};
+
+		//arcs of the vertices that are left, counted by their sources
+		size_t arc_count = 0;
+		for (const auto& arcs : out) {
+			arc_count += arcs.size();
+		}
+
+		//false if the arc only replaced a heavier one
+		auto add_arc = [](std::vector<Arc>& arcs, Arc new_arc) {
+			for (Arc& arc : arcs) {
+				if (arc.vertex == new_arc.vertex) {
+					if (new_arc.weight < arc.weight) {
+						arc = new_arc;
+					}
+					return false;
+				}
+			}
+			arcs.push_back(new_arc);
+			return true;
+		};
+
+		auto remove_arc = [](std::vector<Arc>& arcs, VertexId vertex) {
+			arcs.erase(std::remove_if(arcs.begin(), arcs.end(), [vertex](const Arc& arc) {
+				return arc.vertex == vertex;
+			}), arcs.end());
+		};
+
+		using Candidate = std::pair<int, VertexId>;
+		std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> queue;
+		for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+			queue.push({ get_priority(vertex), vertex });
+		}
+
+		ranks_.assign(vertex_count, 0);
+		uint32_t next_rank = 0;
+		std::vector<Edge> shortcuts;
+		while (!queue.empty() && arc_count <= CORE_AVERAGE_DEGREE * (vertex_count - next_rank)) {
+			const VertexId vertex = queue.top().second;
+			queue.pop();
+			if (contracted[vertex]) {
+				continue;
+			}
+			//lazy update: priority is stale only after a neighbour was contracted
+			if (is_stale[vertex]) {
+				is_stale[vertex] = false;
+				const int priority = get_priority(vertex);
+				if (!queue.empty() && priority > queue.top().first) {
+					queue.push({ priority, vertex });
+					continue;
+				}
+			}
+
+			shortcuts.clear();
+			for_each_shortcut(vertex, WITNESS_SETTLE_LIMIT, WITNESS_HOP_LIMIT,
+				[&](VertexId from, VertexId to, double weight, EdgeId first, EdgeId second) {
+				shortcuts.push_back({ from, to, weight, NO_EDGE, first, second });
+			});
+			for (const Edge& shortcut : shortcuts) {
+				const EdgeId id = static_cast<EdgeId>(edges_.size());
+				edges_.push_back(shortcut);
+				edge_hops.push_back(edge_hops[shortcut.first_child] + edge_hops[shortcut.second_child]);
+				if (add_arc(out[shortcut.from], { shortcut.to, shortcut.weight, id })) {
+					++arc_count;
+				}
+				add_arc(in[shortcut.to], { shortcut.from, shortcut.weight, id });
+			}
+
+			contracted[vertex] = true;
+			ranks_[vertex] = next_rank++;
+			arc_count -= in[vertex].size() + out[vertex].size();
+			for (const Arc& arc : in[vertex]) {
+				remove_arc(out[arc.vertex], vertex);
+				++deleted_neighbours[arc.vertex];
+				levels[arc.vertex] = std::max(levels[arc.vertex], levels[vertex] + 1);
+				is_stale[arc.vertex] = true;
+			}
+			for (const Arc& arc : out[vertex]) {
+				remove_arc(in[arc.vertex], vertex);
+				++deleted_neighbours[arc.vertex];
+				levels[arc.vertex] = std::max(levels[arc.vertex], levels[vertex] + 1);
+				is_stale[arc.vertex] = true;
+			}
+			std::vector<Arc>().swap(in[vertex]);
+			std::vector<Arc>().swap(out[vertex]);
+		}
+
+		core_rank_ = next_rank;
+		for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+			if (!contracted[vertex]) {
+				ranks_[vertex] = next_rank++;
+			}
+		}
+	}
+
+	void ContractionHierarchy::BuildSearchGraphs(size_t vertex_count) {
+		up_offsets_.assign(vertex_count + 1, 0);
+		down_offsets_.assign(vertex_count + 1, 0);
+		//edges inside the core are in both graphs
+		auto is_up = [this](const Edge& edge) {
+			return ranks_[edge.from] < ranks_[edge.to] || ranks_[edge.to] >= core_rank_;
+		};
+		auto is_down = [this](const Edge& edge) {
+			return ranks_[edge.from] > ranks_[edge.to] || ranks_[edge.from] >= core_rank_;
+		};
+		for (const Edge& edge : edges_) {
+			if (edge.from == edge.to) {
+				continue;
+			}
+			if (is_up(edge)) {
+				++up_offsets_[edge.from + 1];
+			}
+			if (is_down(edge)) {
+				++down_offsets_[edge.to + 1];
+			}
+		}
+		for (size_t i = 1; i <= vertex_count; ++i) {
+			up_offsets_[i] += up_offsets_[i - 1];
+			down_offsets_[i] += down_offsets_[i - 1];
+		}
+		up_edges_.resize(up_offsets_.back());
+		down_edges_.resize(down_offsets_.back());
+		std::vector<EdgeId> up_positions(up_offsets_.begin(), up_offsets_.end() - 1);
+		std::vector<EdgeId> down_positions(down_offsets_.begin(), down_offsets_.end() - 1);
+		for (EdgeId id = 0; id < edges_.size(); ++id) {
+			const Edge& edge = edges_[id];
+			if (edge.from == edge.to) {
+				continue;
+			}
+			if (is_up(edge)) {
+				up_edges_[up_positions[edge.from]++] = id;
+			}
+			if (is_down(edge)) {
+				down_edges_[down_positions[edge.to]++] = id;
+			}
+		}
+	}
+
+	void ContractionHierarchy::Save(std::ostream& output, uint64_t fingerprint) const {
+		output.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+		WriteValue(output, fingerprint);
+		WriteValue(output, static_cast<uint64_t>(input_edge_count_));
+		WriteValue(output, core_rank_);
+		WriteVector(output, ranks_);
+		WriteVector(output, edges_);
+		WriteVector(output, up_offsets_);
+		WriteVector(output, up_edges_);
+		WriteVector(output, down_offsets_);
+		WriteVector(output, down_edges_);
+	}
+
+	std::optional<ContractionHierarchy> ContractionHierarchy::Load(std::istream& input, uint64_t fingerprint) {
+		char magic[sizeof(FILE_MAGIC)];
+		uint64_t saved_fingerprint = 0;
+		uint64_t input_edge_count = 0;
+		if (!input.read(magic, sizeof(magic)) || std::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0
+			|| !ReadValue(input, saved_fingerprint) || saved_fingerprint != fingerprint
+			|| !ReadValue(input, input_edge_count)) {
+			return std::nullopt;
+		}
+
+		ContractionHierarchy hierarchy;
+		hierarchy.input_edge_count_ = input_edge_count;
+		if (!ReadValue(input, hierarchy.core_rank_)) {
+			return std::nullopt;
+		}
+		if (!ReadVector(input, hierarchy.ranks_) || !ReadVector(input, hierarchy.edges_)
+			|| !ReadVector(input, hierarchy.up_offsets_) || !ReadVector(input, hierarchy.up_edges_)
+			|| !ReadVector(input, hierarchy.down_offsets_) || !ReadVector(input, hierarchy.down_edges_)) {
+			return std::nullopt;
+		}
+		const size_t vertex_count = hierarchy.ranks_.size();
+		if (hierarchy.up_offsets_.size() != vertex_count + 1 || hierarchy.down_offsets_.size() != vertex_count + 1
+			|| !std::is_sorted(hierarchy.up_offsets_.begin(), hierarchy.up_offsets_.end())
+			|| !std::is_sorted(hierarchy.down_offsets_.begin(), hierarchy.down_offsets_.end())
+			|| hierarchy.up_offsets_.back() != hierarchy.up_edges_.size()
+			|| hierarchy.down_offsets_.back() != hierarchy.down_edges_.size()) {
+			return std::nullopt;
+		}
+		//ids must stay in range, so broken files can't make queries read out of bounds
+		const size_t edge_count = hierarchy.edges_.size();
+		auto is_edge_id = [edge_count](EdgeId id) {
+			return id < edge_count;
+		};
+		for (const Edge& edge : hierarchy.edges_) {
+			const bool is_input = edge.first_child == NO_EDGE && edge.second_child == NO_EDGE;
+			if (edge.from >= vertex_count || edge.to >= vertex_count
+				|| (!is_input && (!is_edge_id(edge.first_child) || !is_edge_id(edge.second_child)))) {
+				return std::nullopt;
+			}
+		}
+		if (!std::all_of(hierarchy.up_edges_.begin(), hierarchy.up_edges_.end(), is_edge_id)
+			|| !std::all_of(hierarchy.down_edges_.begin(), hierarchy.down_edges_.end(), is_edge_id)) {
+			return std::nullopt;
+		}
+		return hierarchy;
+	}
+
+	std::optional<ContractionHierarchy::Path> ContractionHierarchy::FindPath(VertexId from, VertexId to, Scratch& scratch) const {
+		const size_t vertex_count = ranks_.size();
+		if (from >= vertex_count || to >= vertex_count) {
+			return std::nullopt;
+		}
+
+		auto reset = [vertex_count](Scratch::Direction& direction) {
+			if (direction.distances.size() != vertex_count) {
+				direction.distances.assign(vertex_count, INFINITE_WEIGHT);
+				direction.parent_edges.assign(vertex_count, NO_EDGE);
+				direction.touched.clear();
+			}
+			for (VertexId vertex : direction.touched) {
+				direction.distances[vertex] = INFINITE_WEIGHT;
+				direction.parent_edges[vertex] = NO_EDGE;
+			}
+			direction.touched.clear();
+			direction.heap.clear();
+			direction.core_heap.clear();
+		};
+		auto start = [](Scratch::Direction& direction, VertexId vertex) {
+			direction.distances[vertex] = 0;
+			direction.touched.push_back(vertex);
+			direction.heap.push_back({ 0, vertex });
+		};
+		reset(scratch.forward_);
+		reset(scratch.backward_);
+		start(scratch.forward_, from);
+		start(scratch.backward_, to);
+
+		double best = from == to ? 0 : INFINITE_WEIGHT;
+		VertexId meeting = from;
+
+		/*Settles one vertex of the direction, is_forward chooses graph and edge end.
+		Upward searches put vertices of the core aside, in the core both searches
+		go along all its edges*/
+		auto step = [&](Scratch::Direction& direction, const Scratch::Direction& other, bool is_forward, bool is_in_core) {
+			std::pop_heap(direction.heap.begin(), direction.heap.end(), is_later);
+			const auto [distance, vertex] = direction.heap.back();
+			direction.heap.pop_back();
+			if (distance > direction.distances[vertex]) {
+				return;
+			}
+			if (!is_in_core && ranks_[vertex] >= core_rank_) {
+				direction.core_heap.push_back({ distance, vertex });
+				return;
+			}
+			const auto& offsets = is_forward ? up_offsets_ : down_offsets_;
+			const auto& edge_ids = is_forward ? up_edges_ : down_edges_;
+			//stall on demand: the vertex isn't on a shortest path if a more important one gets to it faster
+			if (!is_in_core) {
+				const auto& stall_offsets = is_forward ? down_offsets_ : up_offsets_;
+				const auto& stall_edge_ids = is_forward ? down_edges_ : up_edges_;
+				for (EdgeId i = stall_offsets[vertex]; i < stall_offsets[vertex + 1]; ++i) {
+					const Edge& edge = edges_[stall_edge_ids[i]];
+					const VertexId previous = is_forward ? edge.from : edge.to;
+					if (direction.distances[previous] + edge.weight < distance) {
+						return;
+					}
+				}
+			}
+			for (EdgeId i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+				const Edge& edge = edges_[edge_ids[i]];
+				const VertexId next = is_forward ? edge.to : edge.from;
+				const double new_distance = distance + edge.weight;
+				if (new_distance < direction.distances[next]) {
+					if (direction.distances[next] == INFINITE_WEIGHT) {
+						direction.touched.push_back(next);
+					}
+					direction.distances[next] = new_distance;
+					direction.parent_edges[next] = edge_ids[i];
+					direction.heap.push_back({ new_distance, next });
+					std::push_heap(direction.heap.begin(), direction.heap.end(), is_later);
+					if (new_distance + other.distances[next] < best) {
+						best = new_distance + other.distances[next];
+						meeting = next;
+					}
+				}
+			}
+		};
+
+		auto& forward = scratch.forward_;
+		auto& backward = scratch.backward_;
+		auto get_min = [](const Scratch::Direction& direction) {
+			return direction.heap.empty() ? INFINITE_WEIGHT : direction.heap.front().first;
+		};
+		//upward searches, each one can stop when it can't find a shorter path
+		while (true) {
+			const double forward_min = get_min(forward);
+			const double backward_min = get_min(backward);
+			if (std::min(forward_min, backward_min) >= best) {
+				break;
+			}
+			if (forward_min <= backward_min) {
+				step(forward, backward, true, false);
+			}
+			else {
+				step(backward, forward, false, false);
+			}
+		}
+		//bidirectional Dijkstra in the core from the vertices the upward searches got to
+		forward.heap.swap(forward.core_heap);
+		backward.heap.swap(backward.core_heap);
+		std::make_heap(forward.heap.begin(), forward.heap.end(), is_later);
+		std::make_heap(backward.heap.begin(), backward.heap.end(), is_later);
+		while (true) {
+			const double forward_min = get_min(forward);
+			const double backward_min = get_min(backward);
+			if (forward_min + backward_min >= best) {
+				break;
+			}
+			if (forward_min <= backward_min) {
+				step(forward, backward, true, true);
+			}
+			else {
+				step(backward, forward, false, true);
+			}
+		}
+		if (best == INFINITE_WEIGHT) {
+			return std::nullopt;
+		}
+
+		Path path;
+		path.weight = best;
+		std::vector<EdgeId> upward;
+		for (VertexId vertex = meeting; vertex != from; vertex = edges_[forward.parent_edges[vertex]].from) {
+			upward.push_back(forward.parent_edges[vertex]);
+		}
+		for (auto it = upward.rbegin(); it != upward.rend(); ++it) {
+			UnpackEdge(*it, path.edges);
+		}
+		for (VertexId vertex = meeting; vertex != to; vertex = edges_[backward.parent_edges[vertex]].to) {
+			UnpackEdge(backward.parent_edges[vertex], path.edges);
+		}
+		return path;
+	}
+
+	void ContractionHierarchy::UnpackEdge(EdgeId edge_id, std::vector<EdgeId>& result) const {
+		std::vector<EdgeId> stack{ edge_id };
+		while (!stack.empty()) {
+			const Edge& edge = edges_[stack.back()];
+			stack.pop_back();
+			if (edge.first_child == NO_EDGE) {
+				result.push_back(edge.input_id);
+				continue;
+			}
+			stack.push_back(edge.second_child);
+			stack.push_back(edge.first_child);
+		}
+	}
+
+	size_t ContractionHierarchy::GetShortcutCount() const {
+		return edges_.size() - input_edge_count_;
+	}
+}
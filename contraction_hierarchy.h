@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace tg {
+
+	/*Contraction hierarchy over a directed weighted graph. Vertices are contracted
+	one by one in order of importance, shortcuts keep distances between the rest.
+	Contraction stops when the rest of the graph gets dense, the vertices left
+	form the core and get the highest ranks. Queries are bidirectional Dijkstra
+	searches that go only to more important vertices, so they settle a small
+	part of the graph, and meet in the core with plain bidirectional Dijkstra
+	over its edges. Found paths are unpacked back to the ids of the input edges*/
+	class ContractionHierarchy {
+	public:
+		using VertexId = uint32_t;
+		using EdgeId = uint32_t;
+
+		//Index in the input vector is the id of the edge in found paths
+		struct InputEdge {
+			VertexId from = 0;
+			VertexId to = 0;
+			double weight = 0;
+		};
+
+		struct Path {
+			double weight = 0;
+			std::vector<EdgeId> edges;
+		};
+
+		//Buffers of the query, reused by the queries of one thread
+		class Scratch {
+		private:
+			friend class ContractionHierarchy;
+			struct Direction {
+				std::vector<double> distances;
+				std::vector<EdgeId> parent_edges;
+				std::vector<VertexId> touched;
+				std::vector<std::pair<double, VertexId>> heap;
+				//core vertices reached by the upward search
+				std::vector<std::pair<double, VertexId>> core_heap;
+			};
+			Direction forward_;
+			Direction backward_;
+		};
+
+		static ContractionHierarchy Build(size_t vertex_count, const std::vector<InputEdge>& edges);
+
+		//Identifies the input graph, saved hierarchy is used only for the same graph
+		static uint64_t GetFingerprint(size_t vertex_count, const std::vector<InputEdge>& edges);
+
+		void Save(std::ostream& output, uint64_t fingerprint) const;
+		//nullopt if the data is broken or was saved for another graph
+		static std::optional<ContractionHierarchy> Load(std::istream& input, uint64_t fingerprint);
+
+		std::optional<Path> FindPath(VertexId from, VertexId to, Scratch& scratch) const;
+
+		size_t GetShortcutCount() const;
+
+	private:
+		static constexpr EdgeId NO_EDGE = UINT32_MAX;
+
+		//Input edge if children are NO_EDGE, otherwise shortcut of two edges through the contracted vertex
+		struct Edge {
+			VertexId from = 0;
+			VertexId to = 0;
+			double weight = 0;
+			EdgeId input_id = NO_EDGE;
+			EdgeId first_child = NO_EDGE;
+			EdgeId second_child = NO_EDGE;
+		};
+
+		ContractionHierarchy() = default;
+
+		void Contract(size_t vertex_count);
+		//Search graphs: upward edges by source and downward edges by target
+		void BuildSearchGraphs(size_t vertex_count);
+		void UnpackEdge(EdgeId edge_id, std::vector<EdgeId>& result) const;
+
+		std::vector<uint32_t> ranks_;
+		std::vector<Edge> edges_;
+		std::vector<EdgeId> up_offsets_;
+		std::vector<EdgeId> up_edges_;
+		std::vector<EdgeId> down_offsets_;
+		std::vector<EdgeId> down_edges_;
+		size_t input_edge_count_ = 0;
+		//vertices of the core have ranks from core_rank_
+		uint32_t core_rank_ = 0;
+	};
+}
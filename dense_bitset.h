@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tg {
+
+	//Fixed size set of dense ids, one bit per id
+	class DenseBitset {
+	public:
+		void Resize(size_t size) {
+			words_.assign((size + 63) / 64, 0);
+		}
+
+		size_t GetCapacity() const {
+			return words_.size() * 64;
+		}
+
+		bool Test(size_t id) const {
+			return (words_[id / 64] >> (id % 64)) & 1;
+		}
+
+		void Set(size_t id) {
+			words_[id / 64] |= uint64_t{ 1 } << (id % 64);
+		}
+
+		void Reset(size_t id) {
+			words_[id / 64] &= ~(uint64_t{ 1 } << (id % 64));
+		}
+
+	private:
+		std::vector<uint64_t> words_;
+	};
+}
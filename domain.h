@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
-#include <memory>
 #include <set>
+#include <unordered_set>
 
 #include "geo.h"
 
@@ -11,13 +13,113 @@
 struct Stop {
 	std::string name;
 	tg::detail::Coordinates coordinates;
+	//given by the catalogue in order of adding, never reused, indexes per stop arrays
+	size_t id = 0;
+};
+
+struct Bus;
+
+//Stops of the whole route, non-circle routes are walked there and back
+class RouteStops {
+public:
+	class Iterator {
+	public:
+		Iterator(const Bus* bus, size_t index) : bus_(bus), index_(index) {}
+
+		const Stop* operator*() const;
+		Iterator& operator++() {
+			++index_;
+			return *this;
+		}
+		bool operator==(const Iterator& other) const {
+			return index_ == other.index_;
+		}
+		bool operator!=(const Iterator& other) const {
+			return index_ != other.index_;
+		}
+
+	private:
+		const Bus* bus_;
+		size_t index_;
+	};
+
+	explicit RouteStops(const Bus* bus) : bus_(bus) {}
+
+	Iterator begin() const;
+	Iterator end() const;
+
+private:
+	const Bus* bus_;
 };
 
 //Bus structure
 struct Bus {
 	std::string name;
+	//stops as they are given, the way back of non-circle routes is not stored
 	std::vector<const Stop*> stops;
 	bool isCircle;
+	//counted once when the bus is added
+	int unique_stops = 0;
+	//ids of segments of the whole route in the segment table of the catalogue,
+	//segment i goes from GetStop(i) to GetStop(i + 1)
+	std::vector<uint32_t> segments;
+
+	//Number of stops of the whole route
+	size_t GetStopCount() const {
+		return isCircle || stops.empty() ? stops.size() : stops.size() * 2 - 1;
+	}
+
+	//Stop of the whole route, the way back mirrors stops
+	const Stop* GetStop(size_t index) const {
+		return index < stops.size() ? stops[index] : stops[stops.size() * 2 - 2 - index];
+	}
+
+	RouteStops GetRoute() const {
+		return RouteStops(this);
+	}
+};
+
+inline const Stop* RouteStops::Iterator::operator*() const {
+	return bus_->GetStop(index_);
+}
+
+inline RouteStops::Iterator RouteStops::begin() const {
+	return Iterator(bus_, 0);
+}
+
+inline RouteStops::Iterator RouteStops::end() const {
+	return Iterator(bus_, bus_->GetStopCount());
+}
+
+//Directed pair of neighbour stops of routes, shared by all routes that pass it
+struct RouteSegment {
+	const Stop* from = nullptr;
+	const Stop* to = nullptr;
+	//meters along the great circle
+	double geo_length = 0;
+	//meters, the distance back is used when there is no distance set this way
+	int road_distance = 0;
+};
+
+//Stop found by a bounded search, cost is in meters or minutes depending on the search
+struct ReachedStop {
+	const Stop* stop = nullptr;
+	double cost = 0;
+};
+
+/*What was changed in the catalogue while it tracked changes, indexes built
+over the catalogue are updated by it instead of being built again*/
+struct CatalogueChanges {
+	//names of added, replaced and removed buses
+	std::unordered_set<std::string> buses;
+	//replaced and removed buses, they are destroyed and only serve as keys
+	std::unordered_set<const Bus*> old_buses;
+	//ids of stops of the routes of old_buses
+	std::unordered_set<size_t> old_route_stops;
+	//names of added and removed stops, stops with other coordinates and stops with changed
+	//distances from them. Segments of changed distances go through these stops
+	std::unordered_set<std::string> stops;
+	std::unordered_set<size_t> removed_stops;
 };
 
 struct BusStatistics {
@@ -29,8 +131,7 @@ struct BusStatistics {
 
 
 struct BusComparator {
-	bool operator()(std::shared_ptr<Bus> lhs,
-		std::shared_ptr<Bus> rhs) const {
+	bool operator()(const Bus* lhs, const Bus* rhs) const {
 		return lexicographical_compare(
 			lhs->name.begin(), lhs->name.end(),
 			rhs->name.begin(), rhs->name.end());
@@ -38,13 +139,21 @@ struct BusComparator {
 };
 
 struct StopComparator {
-	bool operator()(std::shared_ptr<Stop> lhs,
-		std::shared_ptr<Stop> rhs) const {
+	bool operator()(const Stop* lhs, const Stop* rhs) const {
 		return lexicographical_compare(
 			lhs->name.begin(), lhs->name.end(),
 			rhs->name.begin(), rhs->name.end());
 	}
 };
 
-using Buses = std::set<std::shared_ptr<Bus>, BusComparator>;
-using Stops = std::set<std::shared_ptr<Stop>, StopComparator>;
\ No newline at end of file
+//Same order as comparison of std::string, used in answers
+struct BusNameComparator {
+	bool operator()(const Bus* lhs, const Bus* rhs) const {
+		return lhs->name < rhs->name;
+	}
+};
+
+//Sorted by name views over the objects owned by the catalogue
+using Buses = std::set<const Bus*, BusComparator>;
+using StopBuses = std::set<const Bus*, BusNameComparator>;
+using Stops = std::set<const Stop*, StopComparator>;
\ No newline at end of file
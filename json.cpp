@@ -1,7 +1,14 @@
 #include "json.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <streambuf>
 #include <unordered_map>
 
+#include "parallel.h"
+
 using namespace std;
 
 namespace json {
@@ -13,11 +20,17 @@ namespace json {
         Node LoadArray(istream& input) {
             Array result;
             char c = '!';
-            for (; input >> c && c != ']';) {
-                if (c != ',') {
-                    input.putback(c);
+            if (input >> c && c != ']') {
+                input.putback(c);
+                while (true) {
+                    result.push_back(LoadNode(input));
+                    if (!(input >> c) || c == ']') {
+                        break;
+                    }
+                    if (c != ',') {
+                        throw ParsingError("Miss ',' between array elements");
+                    }
                 }
-                result.push_back(LoadNode(input));
             }
             if (c != ']') {
                 throw ParsingError("Miss ']' at the end");
@@ -130,13 +143,24 @@ namespace json {
         Node LoadDict(istream& input) {
             Dict result;
             char c = '!'; // Initialize to compare with '}'
-            for (; input >> c && c != '}';) {
-                if (c == ',') {
+            if (input >> c && c != '}') {
+                while (true) {
+                    if (c != '"') {
+                        throw ParsingError("Dict key is expected");
+                    }
+                    string key = LoadString(input).AsString();
+                    if (!(input >> c) || c != ':') {
+                        throw ParsingError("':' is expected after dict key");
+                    }
+                    result.insert({ move(key), LoadNode(input) });
+                    if (!(input >> c) || c == '}') {
+                        break;
+                    }
+                    if (c != ',') {
+                        throw ParsingError("Miss ',' between dict members");
+                    }
                     input >> c;
                 }
-                string key = LoadString(input).AsString();
-                input >> c;
-                result.insert({ move(key), LoadNode(input) });
             }
             if (c != '}') {
                 throw ParsingError("Parse error");
@@ -194,6 +218,274 @@ namespace json {
             }
         }
 
+        // ---------- Parallel loading of large containers ------------------
+
+        //Containers smaller than this are parsed by one thread from the stream
+        constexpr size_t PARALLEL_LOAD_MIN_SIZE = 1 << 20;
+        constexpr size_t PARALLEL_LOAD_MIN_ELEMENTS = 256;
+
+        //Read only stream buffer over the loaded text, nothing is copied
+        class MemoryBuffer : public std::streambuf {
+        public:
+            explicit MemoryBuffer(std::string_view text) {
+                char* begin = const_cast<char*>(text.data());
+                setg(begin, begin, begin + text.size());
+            }
+
+        protected:
+            pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+                if (which != std::ios_base::in || dir != std::ios_base::cur || off != 0) {
+                    return pos_type(off_type(-1));
+                }
+                return pos_type(gptr() - eback());
+            }
+        };
+
+        bool IsSpace(char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+        }
+
+        size_t SkipSpaces(std::string_view text, size_t pos) {
+            while (pos < text.size() && IsSpace(text[pos])) {
+                ++pos;
+            }
+            return pos;
+        }
+
+        //Non zero if some byte of the word equals to the byte
+        uint64_t HasByte(uint64_t word, uint8_t byte) {
+            constexpr uint64_t ONES = 0x0101010101010101ULL;
+            constexpr uint64_t HIGHS = 0x8080808080808080ULL;
+            const uint64_t x = word ^ (ONES * byte);
+            return (x - ONES) & ~x & HIGHS;
+        }
+
+        //text[pos] is the opening quote, returns position after the closing one.
+        //Eight bytes without quotes and backslashes are skipped at once
+        size_t SkipString(std::string_view text, size_t pos) {
+            ++pos;
+            while (pos < text.size()) {
+                if (pos + sizeof(uint64_t) <= text.size()) {
+                    uint64_t word;
+                    std::memcpy(&word, text.data() + pos, sizeof(word));
+                    if (!(HasByte(word, '"') | HasByte(word, '\\'))) {
+                        pos += sizeof(word);
+                        continue;
+                    }
+                }
+                if (text[pos] == '\\') {
+                    pos += 2;
+                }
+                else if (text[pos] == '"') {
+                    return pos + 1;
+                }
+                else {
+                    ++pos;
+                }
+            }
+            throw ParsingError("Failed to read string"s);
+        }
+
+        //Position of the document scan, it stops at the end of the loaded text and goes on after more is read
+        struct DocumentScan {
+            size_t begin = 0;
+            size_t pos = 0;
+            int depth = 0;
+            bool is_in_string = false;
+        };
+
+        /*Moves scan.pos after the document that starts at scan.begin, false if the text ends before.
+        A container ends with the bracket that closes the first one, any other value ends before
+        spaces or the next document. Eight bytes without quotes, backslashes and brackets are skipped at once*/
+        bool ScanDocument(std::string_view text, DocumentScan& scan) {
+            size_t pos = scan.pos;
+            while (pos < text.size()) {
+                if (pos + sizeof(uint64_t) <= text.size()) {
+                    uint64_t word;
+                    std::memcpy(&word, text.data() + pos, sizeof(word));
+                    const uint64_t special = scan.is_in_string
+                        ? HasByte(word, '"') | HasByte(word, '\\')
+                        : HasByte(word, '"') | HasByte(word, '[') | HasByte(word, ']') | HasByte(word, '{') | HasByte(word, '}');
+                    if (!special && (scan.is_in_string || scan.depth != 0)) {
+                        pos += sizeof(word);
+                        continue;
+                    }
+                }
+                const char c = text[pos];
+                if (scan.is_in_string) {
+                    if (c == '\\') {
+                        if (pos + 1 == text.size()) {
+                            break;
+                        }
+                        ++pos;
+                    }
+                    else if (c == '"') {
+                        scan.is_in_string = false;
+                    }
+                }
+                else if (scan.depth == 0 && pos != scan.begin && (IsSpace(c) || c == '[' || c == '{')) {
+                    scan.pos = pos;
+                    return true;
+                }
+                else if (c == '"') {
+                    scan.is_in_string = true;
+                }
+                else if (c == '[' || c == '{') {
+                    ++scan.depth;
+                }
+                else if ((c == ']' || c == '}') && --scan.depth == 0) {
+                    scan.pos = pos + 1;
+                    return true;
+                }
+                ++pos;
+            }
+            scan.pos = pos;
+            return false;
+        }
+
+        /*Structural pre-scan: text[open] is '[' or '{'. Collects positions
+        of commas that separate elements of this container (nested ones are skipped)
+        and returns position of the closing bracket*/
+        size_t ScanContainer(std::string_view text, size_t open, std::vector<size_t>& separators) {
+            int depth = 0;
+            size_t pos = open;
+            while (pos < text.size()) {
+                switch (text[pos]) {
+                case '"':
+                    pos = SkipString(text, pos);
+                    continue;
+                case '[':
+                case '{':
+                    ++depth;
+                    break;
+                case ']':
+                case '}':
+                    if (--depth == 0) {
+                        return pos;
+                    }
+                    break;
+                case ',':
+                    if (depth == 1) {
+                        separators.push_back(pos);
+                    }
+                    break;
+                default:
+                    break;
+                }
+                ++pos;
+            }
+            throw ParsingError("Container isn't closed"s);
+        }
+
+        Node LoadValue(std::string_view text, size_t& pos);
+
+        //Elements of the array are split into chunks which are parsed on several threads
+        Node LoadArrayParallel(std::string_view text, size_t open, size_t close, const std::vector<size_t>& separators) {
+            if (SkipSpaces(text, open + 1) == close) {
+                return Node(Array());
+            }
+
+            //element i starts after starts[i] and ends at starts[i + 1]
+            std::vector<size_t> starts;
+            starts.reserve(separators.size() + 2);
+            starts.push_back(open);
+            starts.insert(starts.end(), separators.begin(), separators.end());
+            starts.push_back(close);
+            const size_t elements = starts.size() - 1;
+
+            std::vector<Array> chunks(parallel::GetChunkCount(elements, PARALLEL_LOAD_MIN_ELEMENTS));
+            parallel::ForEachChunk(elements, PARALLEL_LOAD_MIN_ELEMENTS,
+                [&](size_t chunk, size_t begin, size_t end) {
+                    Array& result = chunks[chunk];
+                    result.reserve(end - begin);
+                    for (size_t i = begin; i < end; ++i) {
+                        const std::string_view element = text.substr(starts[i] + 1, starts[i + 1] - starts[i] - 1);
+                        if (SkipSpaces(element, 0) == element.size()) {
+                            throw ParsingError("Empty array element"s);
+                        }
+                        MemoryBuffer buffer(element);
+                        std::istream input(&buffer);
+                        result.push_back(LoadNode(input));
+                        //the slice ends at the separator, so anything left misses a comma
+                        if (char c; input >> c) {
+                            throw ParsingError("Miss ',' between array elements");
+                        }
+                    }
+                });
+
+            Array result;
+            result.reserve(elements);
+            for (auto& chunk : chunks) {
+                std::move(chunk.begin(), chunk.end(), std::back_inserter(result));
+            }
+            return Node(move(result));
+        }
+
+        //Members are parsed one by one, large values go to LoadValue again
+        Node LoadDictParallel(std::string_view text, size_t open, size_t close, const std::vector<size_t>& separators) {
+            Dict result;
+            if (SkipSpaces(text, open + 1) == close) {
+                return Node(move(result));
+            }
+
+            size_t member_begin = open + 1;
+            for (size_t i = 0; i <= separators.size(); ++i) {
+                const size_t member_end = i < separators.size() ? separators[i] : close;
+                const std::string_view member = text.substr(member_begin, member_end - member_begin);
+                member_begin = member_end + 1;
+
+                size_t pos = SkipSpaces(member, 0);
+                if (pos == member.size() || member[pos] != '"') {
+                    throw ParsingError("Dict key is expected"s);
+                }
+                const size_t key_end = SkipString(member, pos);
+                MemoryBuffer buffer(member.substr(pos + 1, key_end - pos - 1));
+                std::istream key_input(&buffer);
+                string key = LoadString(key_input).AsString();
+
+                pos = SkipSpaces(member, key_end);
+                if (pos == member.size() || member[pos] != ':') {
+                    throw ParsingError("':' is expected after dict key"s);
+                }
+                ++pos;
+                result.insert({ move(key), LoadValue(member, pos) });
+                if (SkipSpaces(member, pos) != member.size()) {
+                    throw ParsingError("Miss ',' between dict members"s);
+                }
+            }
+            return Node(move(result));
+        }
+
+        //Loads value that starts at pos and moves pos after it
+        Node LoadValue(std::string_view text, size_t& pos) {
+            pos = SkipSpaces(text, pos);
+            if (pos == text.size()) {
+                throw ParsingError("Value is expected"s);
+            }
+
+            if (text[pos] == '[' || text[pos] == '{') {
+                std::vector<size_t> separators;
+                const size_t open = pos;
+                const size_t close = ScanContainer(text, open, separators);
+                pos = close + 1;
+                if (close - open >= PARALLEL_LOAD_MIN_SIZE) {
+                    return text[open] == '['
+                        ? LoadArrayParallel(text, open, close, separators)
+                        : LoadDictParallel(text, open, close, separators);
+                }
+                MemoryBuffer buffer(text.substr(open, pos - open));
+                std::istream input(&buffer);
+                return LoadNode(input);
+            }
+
+            MemoryBuffer buffer(text.substr(pos));
+            std::istream input(&buffer);
+            Node result = LoadNode(input);
+            input.clear();
+            pos += static_cast<size_t>(input.tellg());
+            return result;
+        }
+
     }  // namespace
 
     //As*Type* return Node
@@ -316,6 +608,67 @@ namespace json {
         return Document{ LoadNode(input) };
     }
 
+    DocumentReader::DocumentReader(std::istream& input)
+        : input_(input) {
+    }
+
+    bool DocumentReader::Next(std::string_view& text) {
+        //the previous document isn't needed any more
+        buffer_.erase(0, begin_);
+        begin_ = 0;
+
+        DocumentScan scan;
+        bool is_started = false;
+        while (true) {
+            if (!is_started) {
+                scan.begin = SkipSpaces(buffer_, scan.begin);
+                scan.pos = scan.begin;
+                is_started = scan.begin != buffer_.size();
+            }
+            if (is_started && ScanDocument(buffer_, scan)) {
+                break;
+            }
+            if (!ReadBlock()) {
+                if (!is_started) {
+                    return false;
+                }
+                //an unclosed document is left to the parser to report
+                scan.pos = buffer_.size();
+                break;
+            }
+        }
+        text = std::string_view(buffer_).substr(scan.begin, scan.pos - scan.begin);
+        begin_ = scan.pos;
+        return true;
+    }
+
+    bool DocumentReader::ReadBlock() {
+        using Traits = std::streambuf::traits_type;
+        std::streambuf& buffer = *input_.rdbuf();
+        //waits for the input only when nothing has arrived yet
+        std::streamsize size = buffer.in_avail();
+        if (size <= 0) {
+            if (Traits::eq_int_type(buffer.sgetc(), Traits::eof())) {
+                input_.setstate(std::ios_base::eofbit);
+                return false;
+            }
+            size = std::max<std::streamsize>(buffer.in_avail(), 1);
+        }
+        const size_t old_size = buffer_.size();
+        buffer_.resize(old_size + static_cast<size_t>(size));
+        buffer_.resize(old_size + static_cast<size_t>(buffer.sgetn(buffer_.data() + old_size, size)));
+        return true;
+    }
+
+    Document Load(std::string_view text, size_t* parsed_size) {
+        size_t pos = 0;
+        Document result{ LoadValue(text, pos) };
+        if (parsed_size != nullptr) {
+            *parsed_size = pos;
+        }
+        return result;
+    }
+
     void PrintNode(const Node& node, std::ostream& output);
 
     //operator() for different types.
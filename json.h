@@ -3,6 +3,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 
@@ -65,6 +66,31 @@ namespace json {
 
     Document Load(std::istream& input);
 
+    /*Splits the stream into documents without parsing them. The stream is read
+    by blocks of what has already arrived, so a document is returned as soon as
+    it is complete, without waiting for the next one*/
+    class DocumentReader {
+    public:
+        explicit DocumentReader(std::istream& input);
+
+        //Text of the next document, valid till the next call. False at the end of the stream
+        bool Next(std::string_view& text);
+
+    private:
+        //Appends the next block to buffer_, false at the end of the stream
+        bool ReadBlock();
+
+        std::istream& input_;
+        std::string buffer_;
+        //the text before it was returned already
+        size_t begin_ = 0;
+    };
+
+    /*Loads the first document of the text, its length is stored to parsed_size.
+    Large arrays are split into elements by a structural pre-scan
+    and parsed on several threads*/
+    Document Load(std::string_view text, size_t* parsed_size = nullptr);
+
     void Print(const Document& doc, std::ostream& output);
 
     void PrintNode(const Node& node, std::ostream& output);
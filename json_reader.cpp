@@ -1,92 +1,470 @@
+#include <algorithm>
 #include <fstream>
+#include <limits>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 
 /////
 #include <cassert>
 /////
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <cerrno>
+#include <unistd.h>
+#endif
+
 #include "json_reader.h"
 #include "svg.h"
 #include "map_renderer.h"
+#include "map_cache.h"
+#include "memory_stats.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "trace.h"
 
 
 using namespace std::literals;
 
+namespace {
+    //Smaller parts of base requests aren't worth a thread
+    constexpr size_t MIN_REQUESTS_PER_THREAD = 2048;
+}
+
 void JsonReader::BaseRequestsCommands() {
-    base_requests_ = loaded_requests_.at("base_requests"s).AsArray();
+    {
+        trace::Span span("ClassifyBaseRequests"sv, "ingest"sv);
+        ClassifyBaseRequests();
+    }
 
-    BaseRequestsStops();
-    BaseRequestsDistances();
-    BaseRequestsBuses();
-    BaseRequestsRenderSettings();
+    {
+        metrics::ScopedTimer timer(metrics::Probe::BASE_STOPS);
+        trace::Span span("BaseRequestsStops"sv, "ingest"sv);
+        BaseRequestsStops();
+    }
+    {
+        metrics::ScopedTimer timer(metrics::Probe::BASE_DISTANCES);
+        trace::Span span("BaseRequestsDistances"sv, "ingest"sv);
+        BaseRequestsDistances();
+    }
+    {
+        metrics::ScopedTimer timer(metrics::Probe::BASE_BUSES);
+        trace::Span span("BaseRequestsBuses"sv, "ingest"sv);
+        BaseRequestsBuses();
+    }
+    {
+        metrics::ScopedTimer timer(metrics::Probe::BASE_RENDER_SETTINGS);
+        trace::Span span("BaseRequestsRenderSettings"sv, "ingest"sv);
+        BaseRequestsRenderSettings();
+    }
+    {
+        trace::Span span("BaseRequestsRoutingSettings"sv, "ingest"sv);
+        BaseRequestsRoutingSettings();
+    }
+    base_version_ = trans_guide_.GetVersion();
+    //the graph and the hierarchy are ready before the first Route request
+    if (routing_settings_) {
+        metrics::ScopedTimer timer(metrics::Probe::BASE_ROUTER);
+        GetRouter();
+    }
+}
+
+//split base requests by type in one pass
+void JsonReader::ClassifyBaseRequests() {
+    stop_requests_.clear();
+    bus_requests_.clear();
+    for (const auto& request : loaded_requests_.at("base_requests"s).AsArray()) {
+        const auto& data_node = request.AsMap();
+        const std::string& type = data_node.at("type"s).AsString();
+        if (type == "Stop"sv) {
+            stop_requests_.push_back(&data_node);
+        }
+        else if (type == "Bus"sv) {
+            bus_requests_.push_back(&data_node);
+        }
+    }
 }
 
 //load render settings
 void JsonReader::BaseRequestsRenderSettings() {
-    render_settings_ = loaded_requests_.at("render_settings"s).AsMap();
+    if (loaded_requests_.count("render_settings"s) == 0)
+        return;
+    const json::Node& render_settings = loaded_requests_.at("render_settings"s);
+    render_settings_ = CompileRenderSettings(render_settings.AsMap());
+    //maps rendered with other settings are cached apart
+    std::ostringstream settings_text;
+    json::Print(json::Document(render_settings), settings_text);
+    render_settings_text_ = settings_text.str();
+}
+
+//load routing settings
+void JsonReader::BaseRequestsRoutingSettings() {
+    if (loaded_requests_.count("routing_settings"s) == 0)
+        return;
+    const auto& routing_settings = loaded_requests_.at("routing_settings"s).AsMap();
+    tg::RoutingSettings settings;
+    settings.bus_wait_time = routing_settings.at("bus_wait_time"s).AsDouble();
+    settings.bus_velocity = routing_settings.at("bus_velocity"s).AsDouble();
+    //the file of the hierarchy turns it on
+    if (routing_settings.count("contraction_hierarchy_file"s) != 0) {
+        settings.use_contraction_hierarchy = true;
+        settings.hierarchy_file = routing_settings.at("contraction_hierarchy_file"s).AsString();
+    }
+    if (routing_settings.count("contraction_hierarchy"s) != 0)
+        settings.use_contraction_hierarchy = routing_settings.at("contraction_hierarchy"s).AsBool();
+    routing_settings_ = std::move(settings);
+    router_.reset();
 }
 
 //load stops from json to transport guide
 void JsonReader::BaseRequestsStops() {
-    for (const auto& request : base_requests_) {
-        const auto& data_node = request.AsMap();
-        if (data_node.at("type"s).AsString() == "Stop"s) {
-            std::string temp_stop_name = data_node.at("name").AsString();
-            Coordinates temp_stop_coordinates {
-                data_node.at("latitude"s).AsDouble(),
-                data_node.at("longitude"s).AsDouble()
-            };
-            trans_guide_.AddStop(temp_stop_name, temp_stop_coordinates);
-        }
+    std::vector<Coordinates> coordinates(stop_requests_.size());
+    parallel::ForEachChunk(stop_requests_.size(), MIN_REQUESTS_PER_THREAD,
+        [this, &coordinates](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const auto& data_node = *stop_requests_[i];
+                coordinates[i] = {
+                    data_node.at("latitude"s).AsDouble(),
+                    data_node.at("longitude"s).AsDouble()
+                };
+            }
+        });
+
+    //the guide isn't thread safe, stops are added in the order of requests
+    trans_guide_.ReserveStops(stop_requests_.size());
+    for (size_t i = 0; i < stop_requests_.size(); ++i) {
+        trans_guide_.AddStop(stop_requests_[i]->at("name"s).AsString(), coordinates[i]);
     }
 }
 
 //load buses from json to transport guide
 void JsonReader::BaseRequestsBuses() {
-    for (const auto& request : base_requests_) {
-        std::vector<std::string> temp_stops_vec;
-        const auto& data_node = request.AsMap();
-        if (data_node.at("type"s).AsString() == "Bus"s) {
-            std::string temp_bus_name = data_node.at("name").AsString();
-            bool is_circle = data_node.at("is_roundtrip").AsBool();
-            for (const auto& stop : data_node.at("stops"s).AsArray()) {
-                temp_stops_vec.push_back(stop.AsString());
+    //stops are resolved in parallel, unknown stops stay nullptr
+    std::vector<std::vector<const Stop*>> routes(bus_requests_.size());
+    parallel::ForEachChunk(bus_requests_.size(), MIN_REQUESTS_PER_THREAD,
+        [this, &routes](size_t, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const auto& stops = bus_requests_[i]->at("stops"s).AsArray();
+                routes[i].reserve(stops.size());
+                for (const auto& stop : stops) {
+                    routes[i].push_back(trans_guide_.FindStop(stop.AsString()));
+                }
             }
+        });
 
-            trans_guide_.AddBus(temp_bus_name, temp_stops_vec, is_circle );
+    for (size_t i = 0; i < bus_requests_.size(); ++i) {
+        const auto& data_node = *bus_requests_[i];
+        const auto& stops = data_node.at("stops"s).AsArray();
+        for (size_t j = 0; j < routes[i].size(); ++j) {
+            if (routes[i][j] != nullptr)
+                continue;
+            //stop without description, it is added with zero coordinates
+            const std::string& stop_name = stops[j].AsString();
+            if (!trans_guide_.HasStop(stop_name))
+                trans_guide_.AddStopWithoutCoordinates(stop_name);
+            routes[i][j] = trans_guide_.FindStop(stop_name);
         }
+
+        trans_guide_.AddBus(data_node.at("name"s).AsString(), std::move(routes[i]),
+            data_node.at("is_roundtrip"s).AsBool());
     }
 }
 
 //load distances between stops from json to transport guide
 void JsonReader::BaseRequestsDistances() {
-    for (const auto& request : base_requests_) {
-        const auto& description = request.AsMap();
-        if (description.at("type"s).AsString() == "Stop"s) {
-            const auto from = trans_guide_.FindStop(description.at("name"s).AsString());
-            for (const auto& [stop_name, distance] : description.at("road_distances"s).AsMap()) {
-                trans_guide_.SetStopsDistance(from->name, stop_name, (distance.AsInt()));
+    struct Distance {
+        const Stop* from;
+        const Stop* to;
+        int distance;
+    };
+
+    std::vector<std::vector<Distance>> chunks(
+        parallel::GetChunkCount(stop_requests_.size(), MIN_REQUESTS_PER_THREAD));
+    parallel::ForEachChunk(stop_requests_.size(), MIN_REQUESTS_PER_THREAD,
+        [this, &chunks](size_t chunk, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const auto& description = *stop_requests_[i];
+                const Stop* from = trans_guide_.FindStop(description.at("name"s).AsString());
+                for (const auto& [stop_name, distance] : description.at("road_distances"s).AsMap()) {
+                    if (const Stop* to = trans_guide_.FindStop(stop_name)) {
+                        chunks[chunk].push_back({ from, to, distance.AsInt() });
+                    }
+                }
+            }
+        });
+
+    for (const auto& chunk : chunks) {
+        for (const auto& [from, to, distance] : chunk) {
+            trans_guide_.SetStopsDistance(from, to, distance);
+        }
+    }
+}
+
+namespace {
+    enum class DeltaAction {
+        ADD,
+        REPLACE,
+        REMOVE,
+    };
+
+    //"action" is optional, request without it adds data. Nothing for unknown actions
+    std::optional<DeltaAction> GetDeltaAction(const json::Dict& request) {
+        const auto action = request.find("action"s);
+        if (action == request.end() || action->second.AsString() == "add"s)
+            return DeltaAction::ADD;
+        if (action->second.AsString() == "replace"s)
+            return DeltaAction::REPLACE;
+        if (action->second.AsString() == "remove"s)
+            return DeltaAction::REMOVE;
+        return std::nullopt;
+    }
+}
+
+void JsonReader::DeltaRequestsCommands() {
+    metrics::ScopedTimer timer(metrics::Probe::DELTA);
+    trace::Span span("DeltaRequests"sv, "ingest"sv);
+    const json::Array& delta_requests = loaded_requests_.at("delta_requests"s).AsArray();
+    const uint64_t old_version = trans_guide_.GetVersion();
+    CatalogueChanges changes;
+    trans_guide_.TrackChanges(&changes);
+
+    /*Requests are applied in the same order as base requests:
+    stops, distances and buses. Stops are removed last
+    because buses of this delta could stop going through them.
+    Requests with unknown action are skipped and counted as errors*/
+    std::vector<const json::Dict*> stops, distances, buses, removed_stops;
+    for (const auto& request : delta_requests) {
+        const auto& data_node = request.AsMap();
+        const auto& type = data_node.at("type"s).AsString();
+        const auto action = GetDeltaAction(data_node);
+        if (!action) {
+            timer.SetError();
+            continue;
+        }
+        if (type == "Stop"s) {
+            if (action == DeltaAction::REMOVE)
+                removed_stops.push_back(&data_node);
+            else
+                stops.push_back(&data_node);
+        }
+        else if (type == "Distance"s) {
+            distances.push_back(&data_node);
+        }
+        else if (type == "Bus"s) {
+            buses.push_back(&data_node);
+        }
+    }
+
+    for (const auto stop : stops)
+        DeltaRequestsStop(*stop);
+    for (const auto stop : stops)
+        DeltaRequestsStopDistances(*stop);
+    for (const auto distance : distances)
+        DeltaRequestsDistance(*distance);
+    for (const auto bus : buses)
+        DeltaRequestsBus(*bus);
+    for (const auto stop : removed_stops)
+        trans_guide_.RemoveStop(stop->at("name"s).AsString());
+    trans_guide_.TrackChanges(nullptr);
+    UpdateIndexes(changes, old_version);
+
+    BaseRequestsRenderSettings();
+}
+
+void JsonReader::UpdateIndexes(const CatalogueChanges& changes, uint64_t old_version) {
+    trace::Span span("UpdateIndexes"sv, "index"sv);
+    const uint64_t version = trans_guide_.GetVersion();
+    if (router_ && router_version_ == old_version) {
+        router_->Update(trans_guide_, changes);
+        router_version_ = version;
+    }
+    if (road_graph_ && road_graph_version_ == old_version) {
+        road_graph_->Update(trans_guide_, changes);
+        road_graph_version_ = version;
+    }
+    if (route_index_ && route_index_version_ == old_version) {
+        route_index_->Update(trans_guide_, changes);
+        route_index_version_ = version;
+    }
+    if (name_trie_ && name_trie_version_ == old_version) {
+        name_trie_->Update(trans_guide_, changes);
+        name_trie_version_ = version;
+    }
+    //old buses are erased first, new ones may take their addresses
+    if (route_tolerances_version_ == old_version) {
+        for (const Bus* bus : changes.old_buses)
+            route_tolerances_.erase(bus);
+        for (const Bus* bus : trans_guide_.FindChangedBuses(changes))
+            route_tolerances_[bus] = render::ComputeRouteTolerances(*bus);
+        route_tolerances_version_ = version;
+    }
+    /*Colors go by positions in the sorted list, so a new or removed bus shifts
+    all positions after it and the list is built again by the next map. Replaced
+    buses take the positions of the old ones in the same order of names*/
+    if (bus_color_indexes_version_ == old_version) {
+        std::vector<size_t> positions;
+        for (const Bus* bus : changes.old_buses) {
+            if (auto position = bus_color_indexes_.find(bus); position != bus_color_indexes_.end()) {
+                positions.push_back(position->second);
+                bus_color_indexes_.erase(position);
             }
         }
+        std::vector<const Bus*> buses;
+        for (const auto& name : changes.buses) {
+            if (const Bus* bus = trans_guide_.FindBus(name))
+                buses.push_back(bus);
+        }
+        if (buses.size() == changes.buses.size() && buses.size() == positions.size()) {
+            std::sort(positions.begin(), positions.end());
+            std::sort(buses.begin(), buses.end(), BusComparator());
+            for (size_t i = 0; i < buses.size(); ++i)
+                bus_color_indexes_[buses[i]] = positions[i];
+            bus_color_indexes_version_ = version;
+        }
+    }
+}
+
+//add or replace stop coordinates
+void JsonReader::DeltaRequestsStop(const json::Dict& request) {
+    trans_guide_.AddStop(request.at("name"s).AsString(), {
+        request.at("latitude"s).AsDouble(),
+        request.at("longitude"s).AsDouble() });
+}
+
+//"add" merges distances from the stop with old ones, "replace" drops old distances from the stop first
+void JsonReader::DeltaRequestsStopDistances(const json::Dict& request) {
+    if (GetDeltaAction(request) == DeltaAction::REPLACE)
+        trans_guide_.RemoveStopDistances(request.at("name"s).AsString());
+    const auto distances = request.find("road_distances"s);
+    if (distances == request.end())
+        return;
+    for (const auto& [stop_name, distance] : distances->second.AsMap()) {
+        trans_guide_.SetStopsDistance(request.at("name"s).AsString(), stop_name, distance.AsInt());
+    }
+}
+
+void JsonReader::DeltaRequestsDistance(const json::Dict& request) {
+    const auto& from = request.at("from"s).AsString();
+    const auto& to = request.at("to"s).AsString();
+    if (GetDeltaAction(request) == DeltaAction::REMOVE)
+        trans_guide_.RemoveStopsDistance(from, to);
+    else
+        trans_guide_.SetStopsDistance(from, to, request.at("distance"s).AsInt());
+}
+
+void JsonReader::DeltaRequestsBus(const json::Dict& request) {
+    const auto& name = request.at("name"s).AsString();
+    if (GetDeltaAction(request) == DeltaAction::REMOVE) {
+        trans_guide_.RemoveBus(name);
+        return;
+    }
+
+    std::vector<std::string> temp_stops_vec;
+    for (const auto& stop : request.at("stops"s).AsArray()) {
+        temp_stops_vec.push_back(stop.AsString());
+    }
+    trans_guide_.AddBus(name, temp_stops_vec, request.at("is_roundtrip"s).AsBool());
+}
+
+namespace {
+    bool IsNotFoundAnswer(const json::Node& answer) {
+        return answer.AsMap().count("error_message"s) != 0;
     }
 }
 
 void JsonReader::StatRequestsCommands(std::ostream& output) {
-    stat_requests_ = loaded_requests_.at("stat_requests"s).AsArray();
+    {
+        memory::Scope memory_scope(memory::Subsystem::JSON_DOM);
+        stat_requests_ = loaded_requests_.at("stat_requests"s).AsArray();
+    }
     json::Array result;
 
     for (const auto& request : stat_requests_) {
         const auto& request_info = request.AsMap();
         const auto& type = request_info.at("type"s).AsString();
         const auto& id = request_info.at("id").AsInt();
+        trace::Span span(type, "stat"sv);
+        if (trace::IsEnabled() && request_info.count("name"s) != 0)
+            span.AddArg("name"sv, request_info.at("name"s).AsString());
         if (type == "Stop"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_STOP);
             result.push_back(StatRequestsStop(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
         }
         else if (type == "Bus"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_BUS);
             result.push_back(StatRequestsBus(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "Stops"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_STOPS);
+            result.push_back(StatRequestsStops(request_info, id));
+        }
+        else if (type == "Buses"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_BUSES);
+            result.push_back(StatRequestsBuses(request_info, id));
         }
         else if (type == "Map"s) {
-            result.push_back(StatRequestsMap(id));
+            const bool is_viewport = request_info.count("bbox"s) != 0 || request_info.count("tile"s) != 0;
+            metrics::ScopedTimer timer(is_viewport ? metrics::Probe::STAT_MAP_VIEWPORT : metrics::Probe::STAT_MAP);
+            result.push_back(StatRequestsMap(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "Metrics"s) {
+            result.push_back(StatRequestsMetrics(id));
+        }
+        else if (type == "NearestStops"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_NEAREST_STOPS);
+            result.push_back(StatRequestsNearestStops(request_info, id));
+        }
+        else if (type == "StopsInRadius"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_STOPS_IN_RADIUS);
+            result.push_back(StatRequestsStopsInRadius(request_info, id));
+        }
+        else if (type == "Route"s) {
+            //routes found by the contraction hierarchy are measured apart from Dijkstra ones
+            const bool is_hierarchy = routing_settings_ && GetRouter().HasHierarchy();
+            metrics::ScopedTimer timer(is_hierarchy ? metrics::Probe::STAT_ROUTE_HIERARCHY : metrics::Probe::STAT_ROUTE);
+            result.push_back(StatRequestsRoute(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "Reachable"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_REACHABLE);
+            result.push_back(StatRequestsReachable(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "DistanceMatrix"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_DISTANCE_MATRIX);
+            result.push_back(StatRequestsDistanceMatrix(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "DirectBuses"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_DIRECT_BUSES);
+            result.push_back(StatRequestsDirectBuses(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "TransferStops"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_TRANSFER_STOPS);
+            result.push_back(StatRequestsTransferStops(request_info, id));
+            timer.SetError(IsNotFoundAnswer(result.back()));
+        }
+        else if (type == "Suggest"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_SUGGEST);
+            result.push_back(StatRequestsSuggest(request_info, id));
+        }
+        else if (type == "LongestBuses"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_LONGEST_BUSES);
+            result.push_back(StatRequestsLongestBuses(request_info, id));
+        }
+        else if (type == "CurvedBuses"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_CURVED_BUSES);
+            result.push_back(StatRequestsCurvedBuses(request_info, id));
+        }
+        else if (type == "BusiestStops"s) {
+            metrics::ScopedTimer timer(metrics::Probe::STAT_BUSIEST_STOPS);
+            result.push_back(StatRequestsBusiestStops(request_info, id));
         }
     }
 
@@ -95,43 +473,37 @@ void JsonReader::StatRequestsCommands(std::ostream& output) {
 }
 
 json::Node JsonReader::StatRequestsStop(const json::Dict& query, const int id) {
-    const Stop* search_result = trans_guide_.FindStop(query.at("name"s).AsString());
+    const Stop* search_result = nullptr;
+    const StopBuses* buses = nullptr;
+    {
+        memory::ZeroAllocationScope no_allocations;
+        search_result = trans_guide_.FindStop(query.at("name"s).AsString());
+        if (search_result != nullptr)
+            buses = &trans_guide_.FindAllBusesToStop(search_result);
+    }
 
     if (search_result == nullptr) 
         return  { json::Dict { {"request_id", id},
                     {"error_message"s, "not found"s} } };
 
-    auto tmp_buses_set = trans_guide_.FindAllBusesToStop(search_result);
+    //buses are already sorted by name
     json::Array buses_node_array;
-    
-    //buses_node_array now is empty so we can return it to have [] buses result
-    if (tmp_buses_set.empty())
-        return { json::Dict { {"buses", buses_node_array},
-                {"request_id"s, id} } };
-
-    //We need to sort buses 
-    std::vector<Bus*> vector_of_buses;
-    for (auto bus : tmp_buses_set) {
-        vector_of_buses.push_back(std::move(bus));
-    }
-
-    std::sort(vector_of_buses.begin(), vector_of_buses.end(),
-        [](Bus* s1, Bus* s2) { return s1->name < s2->name; });
-
-
-    for (const auto bus : vector_of_buses) {
+    buses_node_array.reserve(buses->size());
+    for (const auto bus : *buses) {
         buses_node_array.push_back({ bus->name });
     }
 
-
-
     return { json::Dict { {"buses", buses_node_array},
     {"request_id"s, id} } };
 }
 
 json::Node JsonReader::StatRequestsBus(const json::Dict& query, const int id) {
-    RequestHandler request_handler(trans_guide_);
-    auto optional_bus_info = request_handler.GetBusStat(query.at("name"s).AsString());
+    std::optional<BusStatistics> optional_bus_info;
+    {
+        memory::ZeroAllocationScope no_allocations;
+        RequestHandler request_handler(trans_guide_);
+        optional_bus_info = request_handler.GetBusStat(query.at("name"s).AsString());
+    }
 
     if (optional_bus_info) {
         return { json::Dict {
@@ -147,6 +519,377 @@ json::Node JsonReader::StatRequestsBus(const json::Dict& query, const int id) {
     {"error_message", "not found"s} } };
 }
 
+json::Node JsonReader::StatRequestsStops(const json::Dict& query, const int id) {
+    const auto& names = query.at("names"s).AsArray();
+    //position of the first answer for every name
+    std::unordered_map<std::string_view, size_t> answered;
+    answered.reserve(names.size());
+    json::Array items;
+    items.reserve(names.size());
+    for (const auto& name : names) {
+        const auto [position, is_new] = answered.emplace(name.AsString(), items.size());
+        if (!is_new) {
+            items.push_back(items[position->second]);
+            continue;
+        }
+        const Stop* stop = trans_guide_.FindStop(name.AsString());
+        if (stop == nullptr) {
+            items.push_back(nullptr);
+            continue;
+        }
+        const auto& buses = trans_guide_.FindAllBusesToStop(stop);
+        json::Array bus_names;
+        bus_names.reserve(buses.size());
+        for (const auto bus : buses)
+            bus_names.push_back(bus->name);
+        items.push_back(std::move(bus_names));
+    }
+    return { json::Dict {
+    {"items"s, std::move(items)},
+    {"request_id"s, id} } };
+}
+
+json::Node JsonReader::StatRequestsBuses(const json::Dict& query, const int id) {
+    const auto& names = query.at("names"s).AsArray();
+    const RequestHandler request_handler(trans_guide_);
+    std::unordered_map<std::string_view, size_t> answered;
+    answered.reserve(names.size());
+    json::Array items;
+    items.reserve(names.size());
+    for (const auto& name : names) {
+        const auto [position, is_new] = answered.emplace(name.AsString(), items.size());
+        if (!is_new) {
+            items.push_back(items[position->second]);
+            continue;
+        }
+        const Bus* bus = trans_guide_.FindBus(name.AsString());
+        if (bus == nullptr) {
+            items.push_back(nullptr);
+            continue;
+        }
+        //same order as keys of the Bus answer
+        const BusStatistics statistics = request_handler.GetBusStat(bus);
+        items.push_back(json::Array { statistics.curvature, statistics.route_length,
+            statistics.stops, statistics.unique_stops });
+    }
+    return { json::Dict {
+    {"items"s, std::move(items)},
+    {"request_id"s, id} } };
+}
+
+namespace {
+    //Same keys as the Bus answer and the name
+    json::Node RankedBusesToJson(const std::vector<tg::RankedBus>& buses, const int id) {
+        json::Array buses_node_array;
+        buses_node_array.reserve(buses.size());
+        for (const auto& [bus, statistics] : buses) {
+            buses_node_array.push_back(json::Dict {
+                {"curvature"s, statistics.curvature},
+                {"name"s, bus->name},
+                {"route_length"s, statistics.route_length},
+                {"stop_count"s, statistics.stops},
+                {"unique_stop_count"s, statistics.unique_stops} });
+        }
+        return { json::Dict {
+        {"buses"s, std::move(buses_node_array)},
+        {"request_id"s, id} } };
+    }
+
+    size_t GetCount(const json::Dict& query, size_t default_count) {
+        return query.count("count"s) ? std::max(query.at("count"s).AsInt(), 0) : default_count;
+    }
+}
+
+json::Node JsonReader::StatRequestsLongestBuses(const json::Dict& query, const int id) {
+    return RankedBusesToJson(trans_guide_.GetLongestBuses(GetCount(query, 20)), id);
+}
+
+json::Node JsonReader::StatRequestsCurvedBuses(const json::Dict& query, const int id) {
+    const double min_curvature = query.at("min_curvature"s).AsDouble();
+    return RankedBusesToJson(trans_guide_.FindBusesWithCurvatureAbove(min_curvature,
+        GetCount(query, std::numeric_limits<size_t>::max())), id);
+}
+
+json::Node JsonReader::StatRequestsBusiestStops(const json::Dict& query, const int id) {
+    json::Array stops;
+    for (const auto& [stop, bus_count] : trans_guide_.GetBusiestStops(GetCount(query, 20))) {
+        stops.push_back(json::Dict {
+            {"bus_count"s, static_cast<int>(bus_count)},
+            {"name"s, stop->name} });
+    }
+    return { json::Dict {
+    {"request_id"s, id},
+    {"stops"s, std::move(stops)} } };
+}
+
+namespace {
+    json::Node StopDistancesToJson(const std::vector<tg::StopDistance>& stops, const int id) {
+        json::Array stops_node_array;
+        stops_node_array.reserve(stops.size());
+        for (const auto& [stop, distance] : stops) {
+            stops_node_array.push_back(json::Dict {
+                {"distance"s, distance},
+                {"name"s, stop->name} });
+        }
+
+        return { json::Dict {
+        {"request_id"s, id},
+        {"stops"s, stops_node_array} } };
+    }
+
+    Coordinates CoordinatesFromJson(const json::Dict& query) {
+        return { query.at("latitude"s).AsDouble(), query.at("longitude"s).AsDouble() };
+    }
+}
+
+json::Node JsonReader::StatRequestsNearestStops(const json::Dict& query, const int id) {
+    const int count = query.count("count"s) != 0 ? query.at("count"s).AsInt() : 1;
+    return StopDistancesToJson(
+        trans_guide_.FindNearestStops(CoordinatesFromJson(query), std::max(count, 0)), id);
+}
+
+json::Node JsonReader::StatRequestsStopsInRadius(const json::Dict& query, const int id) {
+    return StopDistancesToJson(
+        trans_guide_.FindStopsInRadius(CoordinatesFromJson(query), query.at("radius"s).AsDouble()), id);
+}
+
+const tg::TransportRouter& JsonReader::GetRouter() {
+    if (router_ && router_version_ == trans_guide_.GetVersion()) {
+        if (router_->IsHierarchyStale()) {
+            trace::Span span("BuildHierarchy"sv, "index"sv);
+            router_->BuildHierarchy(trans_guide_);
+        }
+        return *router_;
+    }
+
+    trace::Span span("BuildRouter"sv, "index"sv);
+    tg::RoutingSettings settings = routing_settings_.value();
+    //hierarchies of changed catalogues don't overwrite the saved one
+    if (base_version_ != trans_guide_.GetVersion())
+        settings.hierarchy_file.clear();
+    router_.reset();
+    router_ = std::make_unique<tg::TransportRouter>(trans_guide_, std::move(settings));
+    router_version_ = trans_guide_.GetVersion();
+    return *router_;
+}
+
+json::Node JsonReader::StatRequestsRoute(const json::Dict& query, const int id) {
+    const Stop* from = trans_guide_.FindStop(query.at("from"s).AsString());
+    const Stop* to = trans_guide_.FindStop(query.at("to"s).AsString());
+    std::optional<tg::Itinerary> itinerary;
+    //without routing_settings there is no router, routes are not found
+    if (from != nullptr && to != nullptr && routing_settings_)
+        itinerary = GetRouter().FindRoute(from, to);
+
+    if (!itinerary)
+        return  { json::Dict { {"request_id", id},
+                    {"error_message"s, "not found"s} } };
+
+    json::Array items;
+    items.reserve(itinerary->items.size());
+    for (const auto& item : itinerary->items) {
+        if (item.bus == nullptr)
+            items.push_back(json::Dict {
+                {"type"s, "Wait"s},
+                {"stop_name"s, item.stop->name},
+                {"time"s, item.time} });
+        else
+            items.push_back(json::Dict {
+                {"type"s, "Bus"s},
+                {"bus"s, item.bus->name},
+                {"span_count"s, item.span_count},
+                {"time"s, item.time} });
+    }
+    return { json::Dict {
+    {"request_id"s, id},
+    {"total_time"s, itinerary->total_time},
+    {"items"s, std::move(items)} } };
+}
+
+const tg::RoadGraph& JsonReader::GetRoadGraph() {
+    if (road_graph_ && road_graph_version_ == trans_guide_.GetVersion())
+        return *road_graph_;
+
+    trace::Span span("BuildRoadGraph"sv, "index"sv);
+    road_graph_ = std::make_unique<tg::RoadGraph>(trans_guide_);
+    road_graph_version_ = trans_guide_.GetVersion();
+    return *road_graph_;
+}
+
+json::Node JsonReader::StatRequestsDistanceMatrix(const json::Dict& query, const int id) {
+    //unknown stops make the whole answer not found
+    auto find_stops = [this](const json::Array& names) {
+        std::vector<const Stop*> stops;
+        stops.reserve(names.size());
+        for (const auto& name : names) {
+            const Stop* stop = trans_guide_.FindStop(name.AsString());
+            if (stop == nullptr)
+                return std::vector<const Stop*>{};
+            stops.push_back(stop);
+        }
+        return stops;
+    };
+    const auto& source_names = query.at("sources"s).AsArray();
+    const auto& target_names = query.at("targets"s).AsArray();
+    const auto sources = find_stops(source_names);
+    const auto targets = find_stops(target_names);
+    if (sources.size() != source_names.size() || targets.size() != target_names.size())
+        return  { json::Dict { {"request_id", id},
+                    {"error_message"s, "not found"s} } };
+
+    const auto matrix = GetRoadGraph().FindDistanceMatrix(sources, targets);
+    json::Array rows;
+    rows.reserve(matrix.size());
+    for (const auto& row : matrix) {
+        json::Array distances;
+        distances.reserve(row.size());
+        for (const auto& distance : row) {
+            if (distance)
+                distances.push_back(*distance);
+            else
+                distances.push_back(nullptr);
+        }
+        rows.push_back(std::move(distances));
+    }
+    return { json::Dict {
+    {"request_id"s, id},
+    {"distances"s, std::move(rows)} } };
+}
+
+json::Node JsonReader::StatRequestsReachable(const json::Dict& query, const int id) {
+    //one stop or several of them, searched at once
+    std::vector<const Stop*> sources;
+    const auto& from = query.at("from"s);
+    if (from.IsArray()) {
+        for (const auto& name : from.AsArray())
+            sources.push_back(trans_guide_.FindStop(name.AsString()));
+    }
+    else {
+        sources.push_back(trans_guide_.FindStop(from.AsString()));
+    }
+    const bool is_time = query.count("max_minutes"s) != 0;
+    const bool is_found = std::find(sources.begin(), sources.end(), nullptr) == sources.end();
+    if (!is_found || (is_time && !routing_settings_) || (!is_time && query.count("max_meters"s) == 0))
+        return  { json::Dict { {"request_id", id},
+                    {"error_message"s, "not found"s} } };
+
+    const auto reached = is_time
+        ? GetRouter().FindReachable(sources, query.at("max_minutes"s).AsDouble())
+        : GetRoadGraph().FindReachable(sources, query.at("max_meters"s).AsDouble());
+    const std::string cost_key = is_time ? "time"s : "distance"s;
+    json::Array stops;
+    stops.reserve(reached.size());
+    for (const auto& [stop, cost] : reached) {
+        stops.push_back(json::Dict {
+            {cost_key, cost},
+            {"name"s, stop->name} });
+    }
+    return { json::Dict {
+    {"request_id"s, id},
+    {"stops"s, std::move(stops)} } };
+}
+
+const tg::RouteIndex& JsonReader::GetRouteIndex() {
+    if (route_index_ && route_index_version_ == trans_guide_.GetVersion())
+        return *route_index_;
+
+    trace::Span span("BuildRouteIndex"sv, "index"sv);
+    route_index_ = std::make_unique<tg::RouteIndex>(trans_guide_);
+    route_index_version_ = trans_guide_.GetVersion();
+    return *route_index_;
+}
+
+json::Node JsonReader::StatRequestsDirectBuses(const json::Dict& query, const int id) {
+    //"from" and "to" are one stop or several of them, any of them will do
+    auto find_stops = [this](const json::Node& names) {
+        std::vector<const Stop*> stops;
+        if (names.IsArray()) {
+            for (const auto& name : names.AsArray())
+                stops.push_back(trans_guide_.FindStop(name.AsString()));
+        }
+        else {
+            stops.push_back(trans_guide_.FindStop(names.AsString()));
+        }
+        return stops;
+    };
+    const auto from = find_stops(query.at("from"s));
+    const auto to = find_stops(query.at("to"s));
+    if (std::find(from.begin(), from.end(), nullptr) != from.end() || std::find(to.begin(), to.end(), nullptr) != to.end())
+        return  { json::Dict { {"request_id", id},
+                    {"error_message"s, "not found"s} } };
+
+    json::Array buses;
+    for (const Bus* bus : GetRouteIndex().FindDirectBuses(from, to))
+        buses.push_back(bus->name);
+    return { json::Dict {
+    {"request_id"s, id},
+    {"buses"s, std::move(buses)} } };
+}
+
+json::Node JsonReader::StatRequestsTransferStops(const json::Dict& query, const int id) {
+    std::vector<const Bus*> buses;
+    for (const auto& name : query.at("buses"s).AsArray())
+        buses.push_back(trans_guide_.FindBus(name.AsString()));
+    if (buses.empty() || std::find(buses.begin(), buses.end(), nullptr) != buses.end())
+        return  { json::Dict { {"request_id", id},
+                    {"error_message"s, "not found"s} } };
+
+    json::Array stops;
+    for (const Stop* stop : GetRouteIndex().FindSharedStops(buses))
+        stops.push_back(stop->name);
+    return { json::Dict {
+    {"request_id"s, id},
+    {"stops"s, std::move(stops)} } };
+}
+
+const tg::NameTrie& JsonReader::GetNameTrie() {
+    if (name_trie_ && name_trie_version_ == trans_guide_.GetVersion())
+        return *name_trie_;
+
+    trace::Span span("BuildNameTrie"sv, "index"sv);
+    name_trie_ = std::make_unique<tg::NameTrie>(trans_guide_);
+    name_trie_version_ = trans_guide_.GetVersion();
+    return *name_trie_;
+}
+
+json::Node JsonReader::StatRequestsSuggest(const json::Dict& query, const int id) {
+    const size_t limit = query.count("limit"s) ? std::max(query.at("limit"s).AsInt(), 0) : 10;
+    const int max_errors = query.count("max_errors"s) ? query.at("max_errors"s).AsInt() : 0;
+    json::Array items;
+    for (const auto& suggestion : GetNameTrie().Suggest(query.at("prefix"s).AsString(), limit, max_errors)) {
+        json::Array types;
+        if (suggestion.bus)
+            types.push_back("Bus"s);
+        if (suggestion.stop)
+            types.push_back("Stop"s);
+        items.push_back(json::Dict {
+            {"name"s, std::string(suggestion.name)},
+            {"types"s, std::move(types)} });
+    }
+    return { json::Dict {
+    {"request_id"s, id},
+    {"items"s, std::move(items)} } };
+}
+
+json::Node JsonReader::StatRequestsMetrics(const int id) {
+    json::Dict probes;
+    for (const auto& probe : metrics::GetSnapshot()) {
+        probes[std::string(probe.name)] = json::Dict {
+            {"count"s, static_cast<int>(probe.count)},
+            {"errors"s, static_cast<int>(probe.errors)},
+            {"error_rate"s, static_cast<double>(probe.errors) / probe.count},
+            {"mean_us"s, probe.mean_us},
+            {"p50_us"s, probe.p50_us},
+            {"p90_us"s, probe.p90_us},
+            {"p99_us"s, probe.p99_us},
+            {"max_us"s, probe.max_us} };
+    }
+
+    return { json::Dict {
+    {"metrics"s, probes},
+    {"request_id"s, id} } };
+}
+
 svg::Color ColorFromJsonMaker(const json::Array& color_array) {
     //string color
     if (color_array.size() == 3) {
@@ -164,60 +907,203 @@ svg::Color ColorFromJsonMaker(const std::string& color) {
     return render::MakeColor(color);
 }
 
-json::Node JsonReader::StatRequestsMap(const int id) {
-    render::MapRenderer renderer;
+namespace {
+    //"bbox": [min_lat, min_lng, max_lat, max_lng] or "tile": {"z", "x", "y"}
+    std::optional<render::Viewport> ViewportFromJson(const json::Dict& query) {
+        if (const auto bbox = query.find("bbox"s); bbox != query.end()) {
+            const auto& bounds = bbox->second.AsArray();
+            if (bounds.size() != 4)
+                return std::nullopt;
+            render::Viewport viewport{ { bounds[0].AsDouble(), bounds[1].AsDouble() },
+                { bounds[2].AsDouble(), bounds[3].AsDouble() } };
+            if (viewport.min.lat > viewport.max.lat || viewport.min.lng > viewport.max.lng)
+                return std::nullopt;
+            return viewport;
+        }
+        const auto& tile = query.at("tile"s).AsMap();
+        return render::MakeTileViewport(tile.at("z"s).AsInt(), tile.at("x"s).AsInt(), tile.at("y"s).AsInt());
+    }
+}
+
+namespace {
+    bool WriteToFile(const std::string& path, const std::string& data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    }
+
+    //The descriptor stays open, it belongs to the caller
+    bool WriteToDescriptor(int fd, const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+#ifdef _WIN32
+            const int result = _write(fd, data.data() + written,
+                static_cast<unsigned>(std::min<size_t>(data.size() - written, 1u << 30)));
+#else
+            const ssize_t result = write(fd, data.data() + written, data.size() - written);
+            if (result < 0 && errno == EINTR)
+                continue;
+#endif
+            if (result <= 0)
+                return false;
+            written += static_cast<size_t>(result);
+        }
+        return true;
+    }
+
+    /*"output_file": path or "output_fd": descriptor other than standard output. The map is
+    written as raw SVG, the answer has only its size and content hash instead of the escaped text*/
+    std::optional<json::Dict> WriteMapOutOfBand(const json::Dict& query, const std::string& map) {
+        //the size is answered as int, bigger maps are refused
+        if (map.size() > static_cast<size_t>(std::numeric_limits<int>::max()))
+            return std::nullopt;
+        json::Dict answer;
+        bool is_written = false;
+        if (const auto path = query.find("output_file"s); path != query.end()) {
+            is_written = WriteToFile(path->second.AsString(), map);
+            answer["path"s] = path->second.AsString();
+        }
+        else {
+            const int fd = query.at("output_fd"s).AsInt();
+            //answers go to standard output, raw SVG between them would break the stream
+            if (fd == 1)
+                return std::nullopt;
+            is_written = WriteToDescriptor(fd, map);
+            answer["fd"s] = fd;
+        }
+        if (!is_written)
+            return std::nullopt;
+        answer["size"s] = static_cast<int>(map.size());
+        answer["hash"s] = render::HashToString(render::HashBytes(map));
+        return answer;
+    }
+}
 
+json::Node JsonReader::StatRequestsMap(const json::Dict& query, const int id) {
+    std::optional<render::Viewport> viewport;
+    if (query.count("bbox"s) != 0 || query.count("tile"s) != 0) {
+        viewport = ViewportFromJson(query);
+        if (!viewport)
+            return  { json::Dict { {"request_id", id},
+                        {"error_message"s, "not found"s} } };
+    }
+
+    /*The tag is the hash of the map itself, so it stays the same after
+    changes that don't touch the map and between runs*/
+    const auto map = GetMap(viewport);
+    const auto if_none_match = query.find("if_none_match"s);
+    //clients that revalidate get the tag and the map only when it was changed
+    if (if_none_match != query.end() && if_none_match->second.AsString() == map->etag)
+        return { json::Dict {
+        {"request_id"s, id },
+        {"etag"s, map->etag},
+        {"not_modified"s, true} } };
+
+    json::Dict answer;
+    if (query.count("output_file"s) != 0 || query.count("output_fd"s) != 0) {
+        trace::Span span("WriteMapOutOfBand"sv, "render"sv);
+        auto written = WriteMapOutOfBand(query, map->svg);
+        if (!written)
+            return  { json::Dict { {"request_id", id},
+                        {"error_message"s, "cannot write map"s} } };
+        answer = std::move(*written);
+    }
+    else {
+        answer["map"s] = map->svg;
+    }
+    answer["request_id"s] = id;
+    if (if_none_match != query.end())
+        answer["etag"s] = map->etag;
+    return { std::move(answer) };
+}
+
+std::shared_ptr<const render::RenderedMap> JsonReader::GetMap(const std::optional<render::Viewport>& viewport) {
+    render::MapKey key{ trans_guide_.GetVersion(), render_settings_text_, viewport };
+    if (auto map = map_cache_.Find(key))
+        return map;
+
+    memory::Scope memory_scope(memory::Subsystem::SVG_DOCUMENT);
+    auto map = std::make_shared<const render::RenderedMap>(viewport ? RenderMap(*viewport) : RenderMap());
+    map_cache_.Insert(std::move(key), map);
+    return map;
+}
+
+render::Settings JsonReader::CompileRenderSettings(const json::Dict& render_settings) {
     svg::Color underlayer_color;
    
-    if (render_settings_.at("underlayer_color"s).IsString())
-        underlayer_color = ColorFromJsonMaker(render_settings_.at("underlayer_color"s).AsString());
-    else if (render_settings_.at("underlayer_color"s).IsArray())
-        underlayer_color = ColorFromJsonMaker(render_settings_.at("underlayer_color"s).AsArray());
+    if (render_settings.at("underlayer_color"s).IsString())
+        underlayer_color = ColorFromJsonMaker(render_settings.at("underlayer_color"s).AsString());
+    else if (render_settings.at("underlayer_color"s).IsArray())
+        underlayer_color = ColorFromJsonMaker(render_settings.at("underlayer_color"s).AsArray());
 
-    json::Array color_palette_temp_vector = render_settings_.at("color_palette"s).AsArray();
+    const json::Array& color_palette_temp_vector = render_settings.at("color_palette"s).AsArray();
     std::vector<svg::Color> color_palette;
+    color_palette.reserve(color_palette_temp_vector.size());
 
-    for (const auto color : color_palette_temp_vector) {
+    //colors are kept in the form they are printed in, so elements only copy the text
+    for (const auto& color : color_palette_temp_vector) {
         if(color.IsString())
-            color_palette.push_back(ColorFromJsonMaker(color.AsString()));
+            color_palette.push_back(svg::ColorToString(ColorFromJsonMaker(color.AsString())));
         else if (color.IsArray())
-            color_palette.push_back(ColorFromJsonMaker(color.AsArray()));
+            color_palette.push_back(svg::ColorToString(ColorFromJsonMaker(color.AsArray())));
     }
 
     render::Settings settings{
-        render_settings_.at("width"s).AsDouble(),
-        render_settings_.at("height"s).AsDouble(),
-        render_settings_.at("padding"s).AsDouble(),
-        render_settings_.at("line_width"s).AsDouble(),
-        render_settings_.at("stop_radius"s).AsDouble(),
-        render_settings_.at("bus_label_font_size"s).AsInt(),
+        render_settings.at("width"s).AsDouble(),
+        render_settings.at("height"s).AsDouble(),
+        render_settings.at("padding"s).AsDouble(),
+        render_settings.at("line_width"s).AsDouble(),
+        render_settings.at("stop_radius"s).AsDouble(),
+        render_settings.at("bus_label_font_size"s).AsInt(),
 
-        { render_settings_.at("bus_label_offset"s).AsArray()[0].AsDouble(),
-        render_settings_.at("bus_label_offset"s).AsArray()[1].AsDouble() },
+        { render_settings.at("bus_label_offset"s).AsArray()[0].AsDouble(),
+        render_settings.at("bus_label_offset"s).AsArray()[1].AsDouble() },
 
-        render_settings_.at("stop_label_font_size"s).AsInt(),
+        render_settings.at("stop_label_font_size"s).AsInt(),
 
-        { render_settings_.at("stop_label_offset"s).AsArray()[0].AsDouble(),
-        render_settings_.at("stop_label_offset"s).AsArray()[1].AsDouble()},
+        { render_settings.at("stop_label_offset"s).AsArray()[0].AsDouble(),
+        render_settings.at("stop_label_offset"s).AsArray()[1].AsDouble()},
 
-        underlayer_color,
-        render_settings_.at("underlayer_width"s).AsDouble(),
+        svg::ColorToString(underlayer_color),
+        render_settings.at("underlayer_width"s).AsDouble(),
         color_palette
     };
+    if (const auto tolerance = render_settings.find("simplify_tolerance"s); tolerance != render_settings.end())
+        settings.simplify_tolerance = tolerance->second.AsDouble();
+    if (const auto cull_labels = render_settings.find("cull_labels"s); cull_labels != render_settings.end())
+        settings.cull_labels = cull_labels->second.AsBool();
+    return settings;
+}
 
-    renderer.SetSettings(settings);
+std::string JsonReader::RenderMap() {
+    render::MapRenderer renderer;
+    renderer.SetSettings(render_settings_.value());
+    if (renderer.GetSettings().simplify_tolerance > 0)
+        renderer.SetRouteTolerances(GetRouteTolerances());
 
     //
-    const Stops set_of_stops = trans_guide_.GetStopsSharedPtrs();
+    const Stops& set_of_stops = trans_guide_.GetSortedStops();
     Stops ptr_set_with_stops_that_have_buses;
-    for (auto bus_ptr : set_of_stops) {
-        if (trans_guide_.IsStopDontHaveBuses(bus_ptr))
-            ptr_set_with_stops_that_have_buses.insert(bus_ptr);
+    {
+        trace::Span span("CollectStopsWithBuses"sv, "index"sv);
+        for (auto bus_ptr : set_of_stops) {
+            if (trans_guide_.IsStopDontHaveBuses(bus_ptr))
+                ptr_set_with_stops_that_have_buses.insert(bus_ptr);
+        }
     }
 
-    renderer.SetBorder(ptr_set_with_stops_that_have_buses);
-    renderer.SetBusRoute(trans_guide_.GetBusesSharedPtrs());
-    renderer.SetStation(ptr_set_with_stops_that_have_buses);
+    {
+        trace::Span span("SetBorder"sv, "render"sv);
+        renderer.SetBorder(ptr_set_with_stops_that_have_buses);
+    }
+    {
+        trace::Span span("SetBusRoute"sv, "render"sv);
+        renderer.SetBusRoute(trans_guide_.GetSortedBuses());
+    }
+    {
+        trace::Span span("SetStation"sv, "render"sv);
+        renderer.SetStation(ptr_set_with_stops_that_have_buses);
+    }
 
     svg::Document doc = renderer.GetDocument();
 
@@ -227,17 +1113,132 @@ json::Node JsonReader::StatRequestsMap(const int id) {
     file.open("text.txt", std::ios::out);
     doc.Render(file);*/
 
-    doc.Render(render_stream);
+    {
+        trace::Span span("Document::Render"sv, "render"sv);
+        doc.Render(render_stream);
+    }
 
-    return { json::Dict {
-    {"request_id"s, id },
-    {"map", render_stream.str()} } };
+    return render_stream.str();
 }
 
+const std::unordered_map<const Bus*, size_t>& JsonReader::GetBusColorIndexes() {
+    if (bus_color_indexes_version_ == trans_guide_.GetVersion())
+        return bus_color_indexes_;
+
+    bus_color_indexes_.clear();
+    const Buses& buses = trans_guide_.GetSortedBuses();
+    bus_color_indexes_.reserve(buses.size());
+    size_t index = 0;
+    for (const Bus* bus : buses)
+        bus_color_indexes_[bus] = index++;
+    bus_color_indexes_version_ = trans_guide_.GetVersion();
+    return bus_color_indexes_;
+}
 
+const render::RouteTolerances& JsonReader::GetRouteTolerances() {
+    if (route_tolerances_version_ == trans_guide_.GetVersion())
+        return route_tolerances_;
 
+    trace::Span span("ComputeRouteTolerances"sv, "index"sv);
+    route_tolerances_.clear();
+    const Buses& buses = trans_guide_.GetSortedBuses();
+    route_tolerances_.reserve(buses.size());
+    for (const Bus* bus : buses)
+        route_tolerances_[bus] = render::ComputeRouteTolerances(*bus);
+    route_tolerances_version_ = trans_guide_.GetVersion();
+    return route_tolerances_;
+}
+
+std::string JsonReader::RenderMap(const render::Viewport& viewport) {
+    const auto& color_indexes = GetBusColorIndexes();
+    render::MapRenderer renderer;
+    renderer.SetSettings(render_settings_.value());
+    if (renderer.GetSettings().simplify_tolerance > 0)
+        renderer.SetRouteTolerances(GetRouteTolerances());
+    renderer.SetViewport(viewport);
+
+    std::vector<render::VisibleRoute> routes;
+    Stops visible_stops;
+    {
+        trace::Span span("FindInViewport"sv, "index"sv);
+        for (auto& [bus, segments] : trans_guide_.FindRouteSegmentsInBox(viewport.min, viewport.max)) {
+            render::VisibleRoute route{ bus, color_indexes.at(bus), {} };
+            for (size_t segment : segments) {
+                if (!route.runs.empty() && route.runs.back().second + 1 == segment)
+                    route.runs.back().second = segment;
+                else
+                    route.runs.push_back({ segment, segment });
+            }
+            routes.push_back(std::move(route));
+        }
+        std::sort(routes.begin(), routes.end(), [](const render::VisibleRoute& lhs, const render::VisibleRoute& rhs) {
+            return BusComparator()(lhs.bus, rhs.bus);
+        });
+
+        for (const Stop* stop : trans_guide_.FindStopsInBox(viewport.min, viewport.max)) {
+            if (trans_guide_.IsStopDontHaveBuses(stop))
+                visible_stops.insert(stop);
+        }
+    }
+
+    {
+        trace::Span span("SetVisibleBusRoutes"sv, "render"sv);
+        renderer.SetVisibleBusRoutes(routes);
+    }
+    {
+        trace::Span span("SetStation"sv, "render"sv);
+        renderer.SetStation(visible_stops);
+    }
+
+    std::ostringstream render_stream;
+    {
+        trace::Span span("Document::Render"sv, "render"sv);
+        renderer.GetDocument().Render(render_stream);
+    }
+    return render_stream.str();
+}
+
+
+
+/*Input can contain several documents one after another.
+The first one usually fills the guide with base_requests,
+next ones can change it with delta_requests*/
 void JsonReader::RunCommands(std::istream& input, std::ostream& output) {
-    loaded_requests_ = json::Load(input).GetRoot().AsMap();
-    BaseRequestsCommands();
-    StatRequestsCommands(output);
-}
\ No newline at end of file
+    /*Documents are read one by one, so answers to a document are written
+    before the next one arrives. The whole document is read at once
+    so that large arrays can be parsed in parallel*/
+    json::DocumentReader reader(input);
+    std::string_view text;
+    bool is_first_answer = true;
+    while (true) {
+        {
+            memory::Scope memory_scope(memory::Subsystem::JSON_DOM);
+            if (!reader.Next(text))
+                break;
+        }
+        {
+            metrics::ScopedTimer timer(metrics::Probe::JSON_LOAD);
+            trace::Span span("json::Load"sv, "parse"sv);
+            memory::Scope memory_scope(memory::Subsystem::JSON_DOM);
+            loaded_requests_ = json::Load(text).GetRoot().AsMap();
+        }
+        if (loaded_requests_.count("base_requests"s) != 0)
+            BaseRequestsCommands();
+        if (loaded_requests_.count("delta_requests"s) != 0)
+            DeltaRequestsCommands();
+        if (loaded_requests_.count("stat_requests"s) != 0) {
+            if (!is_first_answer)
+                output << '\n';
+            StatRequestsCommands(output);
+            output.flush();
+            is_first_answer = false;
+        }
+
+        //Everything needed is already copied to the guide,
+        //the document isn't kept between runs
+        json::Dict().swap(loaded_requests_);
+        std::vector<const json::Dict*>().swap(stop_requests_);
+        std::vector<const json::Dict*>().swap(bus_requests_);
+        json::Array().swap(stat_requests_);
+    }
+}
@@ -1,10 +1,21 @@
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "transport_catalogue.h"
 #include "json.h"
 #include "domain.h"
 #include "request_handler.h"
 #include "map_renderer.h"
+#include "map_cache.h"
+#include "road_graph.h"
+#include "route_index.h"
+#include "name_trie.h"
+#include "transport_router.h"
 
 class JsonReader {
 public:
@@ -14,27 +25,97 @@ public:
         trans_guide_(trans_guide)  {}
 
     void BaseRequestsCommands();
+    /*Applies add, replace and remove operations for stops,
+    buses and distances to the already filled transport guide*/
+    void DeltaRequestsCommands();
     void StatRequestsCommands(std::ostream& output = std::cout);
 
     void RunCommands(std::istream& input = std::cin, std::ostream& output = std::cout);
 
 private:
+    void ClassifyBaseRequests();
     void BaseRequestsStops();
     void BaseRequestsBuses();
     void BaseRequestsDistances();
     void BaseRequestsRenderSettings();
+    void BaseRequestsRoutingSettings();
+
+    void DeltaRequestsStop(const json::Dict& request);
+    void DeltaRequestsStopDistances(const json::Dict& request);
+    void DeltaRequestsDistance(const json::Dict& request);
+    void DeltaRequestsBus(const json::Dict& request);
 
     json::Node StatRequestsStop(const json::Dict&, const int id);
     json::Node StatRequestsBus(const json::Dict&, const int id);
-    json::Node StatRequestsMap(const int id);
+    //Batches of names, repeated names are answered once and copied
+    json::Node StatRequestsStops(const json::Dict&, const int id);
+    json::Node StatRequestsBuses(const json::Dict&, const int id);
+    json::Node StatRequestsMap(const json::Dict&, const int id);
+    json::Node StatRequestsMetrics(const int id);
+    json::Node StatRequestsNearestStops(const json::Dict&, const int id);
+    json::Node StatRequestsStopsInRadius(const json::Dict&, const int id);
+    json::Node StatRequestsRoute(const json::Dict&, const int id);
+    json::Node StatRequestsDistanceMatrix(const json::Dict&, const int id);
+    json::Node StatRequestsReachable(const json::Dict&, const int id);
+    json::Node StatRequestsDirectBuses(const json::Dict&, const int id);
+    json::Node StatRequestsTransferStops(const json::Dict&, const int id);
+    json::Node StatRequestsSuggest(const json::Dict&, const int id);
+    json::Node StatRequestsLongestBuses(const json::Dict&, const int id);
+    json::Node StatRequestsCurvedBuses(const json::Dict&, const int id);
+    json::Node StatRequestsBusiestStops(const json::Dict&, const int id);
+
+    //Indexes built before delta requests follow their changes, the rest are built again when needed
+    void UpdateIndexes(const CatalogueChanges& changes, uint64_t old_version);
+    //Router over the current catalogue, the hierarchy dropped by delta requests is built again here
+    const tg::TransportRouter& GetRouter();
+    //Road graph over the current catalogue
+    const tg::RoadGraph& GetRoadGraph();
+    //Stop and route bitmaps over the current catalogue
+    const tg::RouteIndex& GetRouteIndex();
+    //Trie of stop and bus names
+    const tg::NameTrie& GetNameTrie();
+
+    //Parsed once when render_settings are loaded
+    static render::Settings CompileRenderSettings(const json::Dict& render_settings);
+    //Cached map of the current catalogue or the map rendered now
+    std::shared_ptr<const render::RenderedMap> GetMap(const std::optional<render::Viewport>& viewport);
+    std::string RenderMap();
+    //Only stops and route segments inside the viewport, found by the spatial index
+    std::string RenderMap(const render::Viewport& viewport);
+    //Position of every bus in the sorted list of buses, rebuilt when buses are added or removed
+    const std::unordered_map<const Bus*, size_t>& GetBusColorIndexes();
+    //Simplification tolerances of every route
+    const render::RouteTolerances& GetRouteTolerances();
 
     /*The base_requests array contains
-    information about bus routesand stops in no particular order.*/
-    json::Array base_requests_;
+    information about bus routesand stops in no particular order.
+    Requests are split by type into pointers to the loaded document*/
+    std::vector<const json::Dict*> stop_requests_;
+    std::vector<const json::Dict*> bus_requests_;
     json::Array stat_requests_;
     tg::TransportGuide& trans_guide_;
     json::Dict loaded_requests_;
-    json::Dict render_settings_;
+    std::optional<render::Settings> render_settings_;
+
+    //Maps are rendered again only when catalogue, render settings or viewport were changed
+    render::MapCache map_cache_;
+    std::string render_settings_text_;
+    std::unordered_map<const Bus*, size_t> bus_color_indexes_;
+    std::optional<uint64_t> bus_color_indexes_version_;
+    std::optional<tg::RoutingSettings> routing_settings_;
+    std::unique_ptr<tg::TransportRouter> router_;
+    std::optional<uint64_t> router_version_;
+    //version of the catalogue loaded by base requests, the hierarchy file is only for it
+    std::optional<uint64_t> base_version_;
+    std::unique_ptr<tg::RoadGraph> road_graph_;
+    std::optional<uint64_t> road_graph_version_;
+    std::unique_ptr<tg::RouteIndex> route_index_;
+    std::optional<uint64_t> route_index_version_;
+    std::unique_ptr<tg::NameTrie> name_trie_;
+    std::optional<uint64_t> name_trie_version_;
+
+    render::RouteTolerances route_tolerances_;
+    std::optional<uint64_t> route_tolerances_version_;
 };
 
 svg::Color ColorFromJsonMaker(const json::Array& color_array);
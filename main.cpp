@@ -1,18 +1,59 @@
 #include <fstream>
 #include <cassert>
 #include <sstream>
+#include <string_view>
 
 #include "json_reader.h"
 #include "transport_catalogue.h"
 #include "json.h"
+#include "memory_stats.h"
+#include "metrics.h"
+#include "parallel.h"
+#include "trace.h"
 
-int main() {
+int main(int argc, char* argv[]) {
     using namespace json;
     using namespace std::literals;
 
+    //json::DocumentReader takes the input by blocks that have arrived, stdio sync
+    //would give them one character at a time
+    static char input_buffer[1 << 20];
+    std::ios::sync_with_stdio(false);
+    std::cin.rdbuf()->pubsetbuf(input_buffer, sizeof(input_buffer));
+
+    //--metrics prints latency of requests to stderr at exit
+    //--trace=<file> writes chrome trace-event json of the run
+    //--memory prints heap usage by subsystem, needs TG_MEMORY_STATS build
+    //--threads=<n> runs parallel parts on n threads instead of one per core
+    bool dump_metrics = false;
+    bool dump_memory = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--metrics"sv) {
+            dump_metrics = true;
+        }
+        else if (arg == "--memory"sv) {
+            dump_memory = true;
+        }
+        else if (arg.substr(0, "--trace="sv.size()) == "--trace="sv) {
+            trace::Start(std::string(arg.substr("--trace="sv.size())));
+        }
+        else if (arg.substr(0, "--threads="sv.size()) == "--threads="sv) {
+            parallel::SetThreadCount(std::stoul(std::string(arg.substr("--threads="sv.size()))));
+        }
+    }
+
     tg::TransportGuide tg1;
     JsonReader reader(tg1);
 
     reader.RunCommands(std::cin,std::cout);
- 
-}
\ No newline at end of file
+
+    trace::Finish();
+
+    if (dump_metrics) {
+        metrics::Dump(std::cerr);
+    }
+    if (dump_memory) {
+        memory::Dump(std::cerr);
+    }
+}
@@ -0,0 +1,96 @@
+#include "map_cache.h"
+
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+namespace render {
+
+    namespace {
+        template <typename Value>
+        uint64_t HashValue(Value value, uint64_t hash) {
+            char bytes[sizeof(Value)];
+            std::memcpy(bytes, &value, sizeof(Value));
+            return HashBytes({ bytes, sizeof(Value) }, hash);
+        }
+    }
+
+    uint64_t HashBytes(std::string_view data, uint64_t hash) {
+        for (const char c : data) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string HashToString(uint64_t hash) {
+        std::ostringstream out;
+        out << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return out.str();
+    }
+
+    bool operator==(const MapKey& lhs, const MapKey& rhs) {
+        if (lhs.version != rhs.version || lhs.settings != rhs.settings
+            || lhs.viewport.has_value() != rhs.viewport.has_value())
+            return false;
+        return !lhs.viewport
+            || (lhs.viewport->min.lat == rhs.viewport->min.lat && lhs.viewport->min.lng == rhs.viewport->min.lng
+                && lhs.viewport->max.lat == rhs.viewport->max.lat && lhs.viewport->max.lng == rhs.viewport->max.lng);
+    }
+
+    size_t MapKeyHasher::operator()(const MapKey& key) const {
+        uint64_t hash = HashValue(key.version, HashBytes(key.settings));
+        if (key.viewport) {
+            hash = HashValue(key.viewport->min.lat, hash);
+            hash = HashValue(key.viewport->min.lng, hash);
+            hash = HashValue(key.viewport->max.lat, hash);
+            hash = HashValue(key.viewport->max.lng, hash);
+        }
+        return static_cast<size_t>(hash);
+    }
+
+    RenderedMap::RenderedMap(std::string svg)
+        : svg(std::move(svg))
+        , etag(HashToString(HashBytes(this->svg))) {
+    }
+
+    // ---------- MapCache ------------------
+
+    MapCache::MapCache(size_t max_bytes)
+        : max_bytes_(max_bytes) {
+    }
+
+    std::shared_ptr<const RenderedMap> MapCache::Find(const MapKey& key) {
+        const auto entry = key_to_entry_.find(key);
+        if (entry == key_to_entry_.end()) {
+            return nullptr;
+        }
+        entries_.splice(entries_.begin(), entries_, entry->second);
+        return entry->second->second;
+    }
+
+    void MapCache::Insert(MapKey key, std::shared_ptr<const RenderedMap> map) {
+        if (const auto entry = key_to_entry_.find(key); entry != key_to_entry_.end()) {
+            const auto position = entry->second;
+            bytes_ -= position->second->svg.size();
+            key_to_entry_.erase(entry);
+            entries_.erase(position);
+        }
+
+        bytes_ += map->svg.size();
+        entries_.emplace_front(std::move(key), std::move(map));
+        key_to_entry_.emplace(entries_.front().first, entries_.begin());
+
+        while (bytes_ > max_bytes_ && entries_.size() > 1) {
+            const Entry& last = entries_.back();
+            bytes_ -= last.second->svg.size();
+            key_to_entry_.erase(last.first);
+            entries_.pop_back();
+        }
+    }
+
+    size_t MapCache::GetSize() const {
+        return entries_.size();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "map_renderer.h"
+
+namespace render {
+
+    //64-bit FNV-1a, the same in every run and on every platform
+    uint64_t HashBytes(std::string_view data, uint64_t hash = 14695981039346656037ull);
+
+    //16 hex digits
+    std::string HashToString(uint64_t hash);
+
+    //What the rendered map depends on, the key of the map in the cache of this process
+    struct MapKey {
+        //version of the catalogue, valid only in this process
+        uint64_t version = 0;
+        //printed render settings
+        std::string settings;
+        //whole map if empty
+        std::optional<Viewport> viewport;
+    };
+
+    bool operator==(const MapKey& lhs, const MapKey& rhs);
+
+    //FNV-1a of all fields, equal hashes are told apart by operator==
+    struct MapKeyHasher {
+        size_t operator()(const MapKey& key) const;
+    };
+
+    struct RenderedMap {
+        explicit RenderedMap(std::string svg);
+
+        std::string svg;
+        //hex hash of the svg, equal tags mean equal maps in any run
+        std::string etag;
+    };
+
+    /*Rendered maps by their keys. The least recently used maps are dropped
+    when total size of the maps is above the limit, the last one is always kept*/
+    class MapCache {
+    public:
+        explicit MapCache(size_t max_bytes = 64 << 20);
+
+        //nullptr if the map isn't cached
+        std::shared_ptr<const RenderedMap> Find(const MapKey& key);
+        void Insert(MapKey key, std::shared_ptr<const RenderedMap> map);
+
+        size_t GetSize() const;
+
+    private:
+        using Entry = std::pair<MapKey, std::shared_ptr<const RenderedMap>>;
+
+        size_t max_bytes_;
+        size_t bytes_ = 0;
+        //most recently used first
+        std::list<Entry> entries_;
+        //keys refer to keys of the entries
+        std::unordered_map<std::reference_wrapper<const MapKey>, std::list<Entry>::iterator,
+            MapKeyHasher, std::equal_to<MapKey>> key_to_entry_;
+    };
+}
@@ -1,7 +1,10 @@
 #include <algorithm>
+#include <cmath>
 #include <iterator>
+#include <limits>
 
 #include "map_renderer.h"
+#include "parallel.h"
 using namespace std;
 
 namespace render {
@@ -27,6 +30,125 @@ namespace render {
         return svg::Rgba(r, g, b, a);
     }
 
+    std::optional<Viewport> MakeTileViewport(int zoom, int x, int y) {
+        if (zoom < 0 || zoom > 30) {
+            return std::nullopt;
+        }
+        const double tiles = std::ldexp(1.0, zoom);
+        if (x < 0 || y < 0 || x >= tiles || y >= tiles) {
+            return std::nullopt;
+        }
+        const double pi = std::acos(-1.0);
+        auto get_lng = [tiles](int x) {
+            return x / tiles * 360.0 - 180.0;
+        };
+        auto get_lat = [tiles, pi](int y) {
+            return std::atan(std::sinh(pi * (1.0 - 2.0 * y / tiles))) * 180.0 / pi;
+        };
+        //tile rows go from north to south
+        return Viewport{ { get_lat(y + 1), get_lng(x) }, { get_lat(y), get_lng(x + 1) } };
+    }
+
+    namespace {
+        //Distance from the point to the segment on the plane of latitude and longitude
+        double GetSegmentDistance(const tg::detail::Coordinates& point,
+            const tg::detail::Coordinates& from, const tg::detail::Coordinates& to) {
+            const double dx = to.lng - from.lng;
+            const double dy = to.lat - from.lat;
+            const double length = dx * dx + dy * dy;
+            double t = 0;
+            if (length > 0) {
+                t = std::clamp(((point.lng - from.lng) * dx + (point.lat - from.lat) * dy) / length, 0.0, 1.0);
+            }
+            return std::hypot(point.lng - from.lng - t * dx, point.lat - from.lat - t * dy);
+        }
+
+        struct SegmentHasher {
+            size_t operator()(const std::pair<const Stop*, const Stop*>& segment) const {
+                std::hash<const void*> hasher;
+                return hasher(segment.first) * 37 + hasher(segment.second);
+            }
+        };
+    }
+
+    std::vector<double> ComputeRouteTolerances(const Bus& bus) {
+        const size_t stop_count = bus.GetStopCount();
+        std::vector<double> tolerances(stop_count, std::numeric_limits<double>::infinity());
+        if (stop_count < 3) {
+            return tolerances;
+        }
+
+        struct Range {
+            size_t first;
+            size_t last;
+            double tolerance;
+        };
+        std::vector<Range> ranges{ { 0, stop_count - 1, std::numeric_limits<double>::infinity() } };
+        while (!ranges.empty()) {
+            const Range range = ranges.back();
+            ranges.pop_back();
+            if (range.last - range.first < 2) {
+                continue;
+            }
+            size_t farthest = range.first + 1;
+            double max_distance = -1;
+            for (size_t i = range.first + 1; i < range.last; ++i) {
+                const double distance = GetSegmentDistance(bus.GetStop(i)->coordinates,
+                    bus.GetStop(range.first)->coordinates, bus.GetStop(range.last)->coordinates);
+                if (distance > max_distance) {
+                    max_distance = distance;
+                    farthest = i;
+                }
+            }
+            //a point can't outlive the point that splits its range
+            const double tolerance = std::min(max_distance, range.tolerance);
+            tolerances[farthest] = tolerance;
+            ranges.push_back({ range.first, farthest, tolerance });
+            ranges.push_back({ farthest, range.last, tolerance });
+        }
+        return tolerances;
+    }
+
+    // ---------- LabelPlacer ------------------    
+
+    LabelPlacer::LabelPlacer(double cell_size)
+        : cell_size_(cell_size) {
+    }
+
+    bool LabelPlacer::TryPlace(svg::Point left_top, svg::Point right_bottom) {
+        const int min_x = static_cast<int>(std::floor(left_top.x / cell_size_));
+        const int max_x = static_cast<int>(std::floor(right_bottom.x / cell_size_));
+        const int min_y = static_cast<int>(std::floor(left_top.y / cell_size_));
+        const int max_y = static_cast<int>(std::floor(right_bottom.y / cell_size_));
+        auto get_key = [](int x, int y) {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+        };
+
+        for (int x = min_x; x <= max_x; ++x) {
+            for (int y = min_y; y <= max_y; ++y) {
+                const auto cell = cells_.find(get_key(x, y));
+                if (cell == cells_.end()) {
+                    continue;
+                }
+                for (size_t index : cell->second) {
+                    const Box& box = boxes_[index];
+                    if (left_top.x < box.right_bottom.x && box.left_top.x < right_bottom.x
+                        && left_top.y < box.right_bottom.y && box.left_top.y < right_bottom.y) {
+                        return false;
+                    }
+                }
+            }
+        }
+
+        boxes_.push_back({ left_top, right_bottom });
+        for (int x = min_x; x <= max_x; ++x) {
+            for (int y = min_y; y <= max_y; ++y) {
+                cells_[get_key(x, y)].push_back(boxes_.size() - 1);
+            }
+        }
+        return true;
+    }
+
     // ---------- SphereProjector ------------------    
 
     SphereProjector::SphereProjector(const tg::detail::Coordinates& left_top,
@@ -47,6 +169,20 @@ namespace render {
                     (max_lat_ - coords.lat) * zoom_coef_ + padding_ };
     }
 
+    void SphereProjector::Project(double* lats, double* lngs, size_t count) const {
+        //same arithmetic as operator(), in loops the compiler can vectorize
+        for (size_t i = 0; i < count; ++i) {
+            lngs[i] = (lngs[i] - min_lon_) * zoom_coef_ + padding_;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            lats[i] = (max_lat_ - lats[i]) * zoom_coef_ + padding_;
+        }
+    }
+
+    double SphereProjector::GetZoom() const {
+        return zoom_coef_;
+    }
+
     // ---------- MapRenderer ------------------    
 
     svg::Document MapRenderer::GetDocument() const {
@@ -55,6 +191,11 @@ namespace render {
 
     void MapRenderer::SetSettings(const Settings& settings) {
         settings_ = settings;
+        label_placer_.reset();
+        if (settings_.cull_labels) {
+            const int font_size = std::max(settings_.bus_label_font_size, settings_.stop_label_font_size);
+            label_placer_.emplace(std::max(4.0 * font_size, 1.0));
+        }
     }
 
     Settings MapRenderer::GetSettings() const {
@@ -63,55 +204,269 @@ namespace render {
 
 
     void MapRenderer::SetBorder(const Stops& stops) {
-        optional<double> min_lat, max_lat, min_lng, max_lng;
+        const size_t count = stops.size();
+        std::vector<double> lats;
+        std::vector<double> lngs;
+        lats.reserve(count);
+        lngs.reserve(count);
+        size_t id_bound = 0;
         for (const auto& stop : stops) {
-                const double lat = stop->coordinates.lat;
-                const double lng = stop->coordinates.lng;
-                min_lat = (min_lat) ? min(*min_lat, lat) : lat;
-                max_lat = (max_lat) ? max(*max_lat, lat) : lat;
-                min_lng = (min_lng) ? min(*min_lng, lng) : lng;
-                max_lng = (max_lng) ? max(*max_lng, lng) : lng;
+            lats.push_back(stop->coordinates.lat);
+            lngs.push_back(stop->coordinates.lng);
+            id_bound = max(id_bound, stop->id + 1);
+        }
+
+        double min_lat = 0, max_lat = 0, min_lng = 0, max_lng = 0;
+        if (count > 0) {
+            min_lat = max_lat = lats[0];
+            min_lng = max_lng = lngs[0];
         }
-        if (!min_lat) {
-            min_lat = max_lat = min_lng = max_lng = 0;
+        //branchless passes over contiguous arrays are vectorized
+        for (size_t i = 0; i < count; ++i) {
+            min_lat = lats[i] < min_lat ? lats[i] : min_lat;
+            max_lat = lats[i] > max_lat ? lats[i] : max_lat;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            min_lng = lngs[i] < min_lng ? lngs[i] : min_lng;
+            max_lng = lngs[i] > max_lng ? lngs[i] : max_lng;
+        }
+        sphere_projector_ = SphereProjector({ min_lat, min_lng }, { max_lat, max_lng }, settings_.width, settings_.height, settings_.padding);
+
+        sphere_projector_.Project(lats.data(), lngs.data(), count);
+        projected_stops_.assign(id_bound, svg::Point());
+        is_projected_.assign(id_bound, false);
+        size_t i = 0;
+        for (const auto& stop : stops) {
+            projected_stops_[stop->id] = { lngs[i], lats[i] };
+            is_projected_[stop->id] = true;
+            ++i;
         }
-        sphere_projector_ = SphereProjector({ min_lat.value(), min_lng.value() }, { max_lat.value(), max_lng.value() }, settings_.width, settings_.height, settings_.padding);
     }
 
     void MapRenderer::SetBusRoute(const Buses& buses) {
-        for (const auto& bus : buses) {
-            RenderBusRoute(*bus);
+        if (settings_.simplify_tolerance > 0) {
+            std::vector<VisibleRoute> routes;
+            routes.reserve(buses.size());
+            for (const auto& bus : buses) {
+                VisibleRoute route{ bus, routes.size(), {} };
+                if (bus->stops.size() > 1) {
+                    route.runs.push_back({ 0, bus->GetStopCount() - 2 });
+                }
+                routes.push_back(std::move(route));
+            }
+            SetVisibleBusRoutes(routes);
+            return;
         }
-        index_color_ = 0;
-        for (const auto& bus : buses) {
-            RenderBusRouteName(*bus);
+        const std::vector<const Bus*> ordered(buses.begin(), buses.end());
+        RenderLayers({
+            { ordered.size(), false, [&](size_t begin, size_t end, svg::Document& document) {
+                for (size_t i = begin; i < end; ++i) {
+                    RenderBusRoute(*ordered[i], GetColor(i), document);
+                }
+            } },
+            { ordered.size(), settings_.cull_labels, [&](size_t begin, size_t end, svg::Document& document) {
+                for (size_t i = begin; i < end; ++i) {
+                    RenderBusRouteName(*ordered[i], GetColor(i), document);
+                }
+            } } });
+    }
+
+    void MapRenderer::SetViewport(const Viewport& viewport) {
+        viewport_ = viewport;
+        projected_stops_.clear();
+        is_projected_.clear();
+        sphere_projector_ = SphereProjector(viewport.min, viewport.max, settings_.width, settings_.height, settings_.padding);
+    }
+
+    void MapRenderer::SetVisibleBusRoutes(const std::vector<VisibleRoute>& routes) {
+        Layer lines{ routes.size(), false, [&](size_t begin, size_t end, svg::Document& document) {
+            for (size_t i = begin; i < end; ++i) {
+                for (const auto& [first, last] : routes[i].runs) {
+                    RenderBusRoute(*routes[i].bus, first, last, GetColor(routes[i].color_index), document);
+                }
+            }
+        } };
+        if (settings_.simplify_tolerance > 0) {
+            //segments are shared between routes
+            lines = { 1, true, [&](size_t, size_t, svg::Document& document) {
+                RenderSimplifiedBusRoutes(routes, document);
+            } };
+        }
+        RenderLayers({ std::move(lines),
+            { routes.size(), settings_.cull_labels, [&](size_t begin, size_t end, svg::Document& document) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (!routes[i].bus->stops.empty()) {
+                        RenderBusRouteName(*routes[i].bus, GetColor(routes[i].color_index), document);
+                    }
+                }
+            } } });
+    }
+
+    void MapRenderer::SetRouteTolerances(const RouteTolerances& tolerances) {
+        route_tolerances_ = &tolerances;
+    }
+
+    void MapRenderer::RenderSimplifiedBusRoutes(const std::vector<VisibleRoute>& routes, svg::Document& document) const {
+        using namespace svg;
+        using Segment = std::pair<const Stop*, const Stop*>;
+        auto get_segment = [](const Bus& bus, size_t index) {
+            const Stop* from = bus.GetStop(index);
+            const Stop* to = bus.GetStop(index + 1);
+            return from < to ? Segment{ from, to } : Segment{ to, from };
+        };
+
+        //the last route that draws the segment
+        std::unordered_map<Segment, size_t, SegmentHasher> owners;
+        for (size_t i = 0; i < routes.size(); ++i) {
+            for (const auto& [first, last] : routes[i].runs) {
+                for (size_t segment = first; segment <= last; ++segment) {
+                    owners[get_segment(*routes[i].bus, segment)] = i;
+                }
+            }
+        }
+
+        const double zoom = sphere_projector_.GetZoom();
+        const double tolerance = zoom > 0 ? settings_.simplify_tolerance / zoom : 0;
+        for (size_t i = 0; i < routes.size(); ++i) {
+            const Bus& bus = *routes[i].bus;
+            const std::vector<double>* point_tolerances = nullptr;
+            if (route_tolerances_ != nullptr) {
+                if (const auto it = route_tolerances_->find(&bus); it != route_tolerances_->end()) {
+                    point_tolerances = &it->second;
+                }
+            }
+            const Color& color = GetColor(routes[i].color_index);
+
+            auto render_run = [&](size_t first, size_t last) {
+                Polyline line;
+                for (size_t point = first; point <= last + 1; ++point) {
+                    if (point == first || point == last + 1 || point_tolerances == nullptr
+                        || (*point_tolerances)[point] > tolerance) {
+                        line.AddPoint(GetPoint(*bus.GetStop(point)));
+                    }
+                }
+                document.Add(line.SetFillColor(NoneColor)
+                    .SetStrokeColor(color)
+                    .SetStrokeWidth(settings_.line_width)
+                    .SetStrokeLineCap(StrokeLineCap::ROUND)
+                    .SetStrokeLineJoin(StrokeLineJoin::ROUND));
+            };
+
+            for (const auto& [first, last] : routes[i].runs) {
+                size_t run_begin = first;
+                bool is_in_run = false;
+                for (size_t segment = first; segment <= last; ++segment) {
+                    auto owner = owners.find(get_segment(bus, segment));
+                    const bool is_drawn = owner->second == i;
+                    if (is_drawn) {
+                        //the segment is drawn once even if the route passes it again
+                        owner->second = routes.size();
+                        if (!is_in_run) {
+                            run_begin = segment;
+                            is_in_run = true;
+                        }
+                    }
+                    else if (is_in_run) {
+                        render_run(run_begin, segment - 1);
+                        is_in_run = false;
+                    }
+                }
+                if (is_in_run) {
+                    render_run(run_begin, last);
+                }
+            }
         }
-        index_color_ = 0;
     }
 
     void MapRenderer::SetStation(const Stops& stops) {
-        for (const auto& stop : stops) {
-                RenderStation(*stop);
+        const std::vector<const Stop*> ordered(stops.begin(), stops.end());
+        RenderLayers({
+            { ordered.size(), false, [&](size_t begin, size_t end, svg::Document& document) {
+                for (size_t i = begin; i < end; ++i) {
+                    RenderStation(*ordered[i], document);
+                }
+            } },
+            { ordered.size(), settings_.cull_labels, [&](size_t begin, size_t end, svg::Document& document) {
+                for (size_t i = begin; i < end; ++i) {
+                    RenderStationName(*ordered[i], document);
+                }
+            } } });
+    }
+
+    void MapRenderer::RenderLayers(const std::vector<Layer>& layers) {
+        struct Task {
+            size_t layer;
+            size_t begin;
+            size_t end;
+        };
+        std::vector<Task> tasks;
+        std::vector<size_t> serial_layers;
+        for (size_t layer = 0; layer < layers.size(); ++layer) {
+            if (layers[layer].is_serial) {
+                serial_layers.push_back(layer);
+                continue;
+            }
+            const size_t size = layers[layer].size;
+            const size_t chunks = parallel::GetChunkCount(size, MIN_ITEMS_PER_TASK);
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                tasks.push_back({ layer, size * chunk / chunks, size * (chunk + 1) / chunks });
+            }
         }
-        for (const auto& stop : stops) {
-                RenderStationName(*stop);
+
+        //serial layers go as one task after the chunks
+        std::vector<svg::Document> task_documents(tasks.size());
+        std::vector<svg::Document> serial_documents(layers.size());
+        const size_t jobs = tasks.size() + (serial_layers.empty() ? 0 : 1);
+        parallel::ForEachChunk(jobs, 1, [&](size_t, size_t begin, size_t end) {
+            for (size_t job = begin; job < end; ++job) {
+                if (job == tasks.size()) {
+                    for (size_t layer : serial_layers) {
+                        layers[layer].render(0, layers[layer].size, serial_documents[layer]);
+                    }
+                    continue;
+                }
+                const Task& task = tasks[job];
+                layers[task.layer].render(task.begin, task.end, task_documents[job]);
+            }
+        });
+
+        size_t task = 0;
+        for (size_t layer = 0; layer < layers.size(); ++layer) {
+            if (layers[layer].is_serial) {
+                document_.Append(std::move(serial_documents[layer]));
+                continue;
+            }
+            for (; task < tasks.size() && tasks[task].layer == layer; ++task) {
+                document_.Append(std::move(task_documents[task]));
+            }
         }
     }
 
-    void MapRenderer::RenderBusRoute(const Bus& bus) {
+    void MapRenderer::RenderBusRoute(const Bus& bus, const svg::Color& color, svg::Document& document) const {
         using namespace svg;
-        document_.Add(CreateBusRoute(bus)
+        document.Add(CreateBusRoute(bus)
             .SetFillColor(NoneColor)
-            .SetStrokeColor(GetColor())
+            .SetStrokeColor(color)
             .SetStrokeWidth(settings_.line_width)
             .SetStrokeLineCap(StrokeLineCap::ROUND)
             .SetStrokeLineJoin(StrokeLineJoin::ROUND));
     }
 
-    void MapRenderer::RenderBusRouteName(const Bus& bus) {
+    void MapRenderer::RenderBusRoute(const Bus& bus, size_t first_segment, size_t last_segment,
+        const svg::Color& color, svg::Document& document) const {
         using namespace svg;
-        const auto& point_begin = GetPoint(bus.stops.front()->coordinates);
-        Text text = Text().SetFillColor(GetColor())
+        document.Add(CreateBusRoute(bus, first_segment, last_segment)
+            .SetFillColor(NoneColor)
+            .SetStrokeColor(color)
+            .SetStrokeWidth(settings_.line_width)
+            .SetStrokeLineCap(StrokeLineCap::ROUND)
+            .SetStrokeLineJoin(StrokeLineJoin::ROUND));
+    }
+
+    void MapRenderer::RenderBusRouteName(const Bus& bus, const svg::Color& color, svg::Document& document) {
+        using namespace svg;
+        const auto& point_begin = GetPoint(*bus.stops.front());
+        Text text = Text().SetFillColor(color)
             .SetPosition(point_begin)
             .SetOffset(settings_.bus_label_offset)
             .SetFontSize(settings_.bus_label_font_size)
@@ -126,32 +481,43 @@ namespace render {
             .SetStrokeLineCap(StrokeLineCap::ROUND)
             .SetStrokeLineJoin(StrokeLineJoin::ROUND);
 
-        document_.Add(underlayer);
-        document_.Add(text);
+        const double bold_width = 0.7;
+        if (IsVisible(bus.stops.front()->coordinates)
+            && TryPlaceLabel(point_begin, settings_.bus_label_offset, settings_.bus_label_font_size, bold_width, bus.name)) {
+            document.Add(underlayer);
+            document.Add(text);
+        }
 
 		if (!bus.isCircle) {
-            const auto& point_end = GetPoint(bus.stops[bus.stops.size()/2]->coordinates);
-			if (((point_begin.x != point_end.x) && (point_begin.y != point_end.y))) {
+            const Stop& stop_end = *bus.stops.back();
+            const auto& point_end = GetPoint(stop_end);
+			if (((point_begin.x != point_end.x) && (point_begin.y != point_end.y)) && IsVisible(stop_end.coordinates)
+                && TryPlaceLabel(point_end, settings_.bus_label_offset, settings_.bus_label_font_size, bold_width, bus.name)) {
 
 				text.SetPosition(point_end);
 				underlayer.SetPosition(point_end);
-				document_.Add(underlayer);
-				document_.Add(text);
+				document.Add(underlayer);
+				document.Add(text);
 			}
 		}
     }
 
-    void MapRenderer::RenderStation(const Stop& stop) {
+    void MapRenderer::RenderStation(const Stop& stop, svg::Document& document) const {
         using namespace svg;
-        document_.Add(Circle().SetCenter(GetPoint(stop.coordinates))
+        document.Add(Circle().SetCenter(GetPoint(stop))
             .SetRadius(settings_.stop_radius)
             .SetFillColor("white"s));
     }
 
-    void MapRenderer::RenderStationName(const Stop& stop) {
+    void MapRenderer::RenderStationName(const Stop& stop, svg::Document& document) {
         using namespace svg;
+        const Point position = GetPoint(stop);
+        const double regular_width = 0.6;
+        if (!TryPlaceLabel(position, settings_.stop_label_offset, settings_.stop_label_font_size, regular_width, stop.name)) {
+            return;
+        }
         Text text = Text().SetFillColor("black"s)
-            .SetPosition(GetPoint(stop.coordinates))
+            .SetPosition(position)
             .SetOffset(settings_.stop_label_offset)
             .SetFontSize(settings_.stop_label_font_size)
             .SetFontFamily("Verdana"s)
@@ -164,30 +530,60 @@ namespace render {
             .SetStrokeLineCap(StrokeLineCap::ROUND)
             .SetStrokeLineJoin(StrokeLineJoin::ROUND);
 
-        document_.Add(underlayer);
-        document_.Add(text);
+        document.Add(underlayer);
+        document.Add(text);
     }
 
     svg::Polyline MapRenderer::CreateBusRoute(const Bus& bus) const {
         using namespace svg;
         svg::Polyline line;
-        const auto& stops = bus.stops;
-        for (auto it = stops.begin(); it != stops.end(); ++it) {
-            const auto& point = GetPoint((*it)->coordinates);
-            line.AddPoint(point);
+        for (const Stop* stop : bus.GetRoute()) {
+            line.AddPoint(GetPoint(*stop));
         }
         return line;
     }
 
-    svg::Color MapRenderer::GetColor() {
-        return settings_.color_palette.at(GetIndexColor());
+    svg::Polyline MapRenderer::CreateBusRoute(const Bus& bus, size_t first_segment, size_t last_segment) const {
+        svg::Polyline line;
+        for (size_t i = first_segment; i <= last_segment + 1; ++i) {
+            line.AddPoint(GetPoint(*bus.GetStop(i)));
+        }
+        return line;
     }
 
-    svg::Point MapRenderer::GetPoint(const tg::detail::Coordinates& coords) const {
-        return sphere_projector_(coords);
+    bool MapRenderer::IsVisible(const tg::detail::Coordinates& coords) const {
+        if (!viewport_) {
+            return true;
+        }
+        return coords.lat >= viewport_->min.lat && coords.lat <= viewport_->max.lat
+            && coords.lng >= viewport_->min.lng && coords.lng <= viewport_->max.lng;
+    }
+
+    bool MapRenderer::TryPlaceLabel(svg::Point position, svg::Point offset, int font_size, double width_factor,
+        const std::string& data) {
+        if (!label_placer_) {
+            return true;
+        }
+        //width is estimated by the average glyph width of the font, data is UTF-8
+        const auto symbols = std::count_if(data.begin(), data.end(), [](char c) {
+            return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        });
+        const double outline = settings_.underlayer_width / 2;
+        const double left = position.x + offset.x - outline;
+        const double baseline = position.y + offset.y;
+        return label_placer_->TryPlace({ left, baseline - font_size - outline },
+            { left + symbols * font_size * width_factor + 2 * outline, baseline + font_size * 0.25 + outline });
     }
 
-    size_t MapRenderer::GetIndexColor() {
-        return index_color_++ % settings_.color_palette.size();
+    const svg::Color& MapRenderer::GetColor(size_t color_index) const {
+        return settings_.color_palette.at(color_index % settings_.color_palette.size());
     }
+
+    svg::Point MapRenderer::GetPoint(const Stop& stop) const {
+        if (stop.id < is_projected_.size() && is_projected_[stop.id]) {
+            return projected_stops_[stop.id];
+        }
+        return sphere_projector_(stop.coordinates);
+    }
+
 }
\ No newline at end of file
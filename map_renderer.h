@@ -1,9 +1,12 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <optional>
+#include <utility>
 #include <vector>
 #include <set>
+#include <unordered_map>
 
 #include "domain.h"
 #include "geo.h"
@@ -23,6 +26,10 @@ namespace render {
         svg::Color underlayer_color;
         double underlayer_width = 0;
         std::vector<svg::Color> color_palette;
+        //Douglas-Peucker tolerance of routes in pixels, 0 draws every stop
+        double simplify_tolerance = 0;
+        //Labels that overlap already placed ones are dropped
+        bool cull_labels = false;
     };
 
     inline const double EPSILON = 1e-6;
@@ -32,6 +39,48 @@ namespace render {
     svg::Color MakeColor(int r, int g, int b);
     svg::Color MakeColor(int r, int g, int b, double a);
 
+    //Part of the map, min is left bottom corner and max is right top one
+    struct Viewport {
+        tg::detail::Coordinates min;
+        tg::detail::Coordinates max;
+    };
+
+    //Bounds of the Web Mercator tile, nullopt for tile outside of the zoom level
+    std::optional<Viewport> MakeTileViewport(int zoom, int x, int y);
+
+    //Bus that crosses the viewport
+    struct VisibleRoute {
+        const Bus* bus = nullptr;
+        //index of the bus on the whole map, keeps the same color on every tile
+        size_t color_index = 0;
+        //inclusive ranges of consecutive segments inside the viewport
+        std::vector<std::pair<size_t, size_t>> runs;
+    };
+
+    /*Douglas-Peucker tolerance of every point of the route in degrees: the point
+    stays while simplification tolerance is below it. Both ends are never dropped*/
+    std::vector<double> ComputeRouteTolerances(const Bus& bus);
+    using RouteTolerances = std::unordered_map<const Bus*, std::vector<double>>;
+
+    /*Rectangles of placed labels in a grid of square cells. A label is placed
+    only if it doesn't overlap labels placed before it, so earlier labels have priority*/
+    class LabelPlacer final {
+    public:
+        explicit LabelPlacer(double cell_size);
+
+        bool TryPlace(svg::Point left_top, svg::Point right_bottom);
+
+    private:
+        struct Box {
+            svg::Point left_top;
+            svg::Point right_bottom;
+        };
+
+        double cell_size_;
+        std::unordered_map<uint64_t, std::vector<size_t>> cells_;
+        std::vector<Box> boxes_;
+    };
+
     class SphereProjector final {
     public:
         SphereProjector() = default;
@@ -41,6 +90,10 @@ namespace render {
             double width, double height, double padding);
 
         svg::Point operator()(const tg::detail::Coordinates& coords) const;
+        //Projects arrays of coordinates, lats become ys and lngs become xs in place
+        void Project(double* lats, double* lngs, size_t count) const;
+        //Pixels per degree
+        double GetZoom() const;
     private:
         double padding_ = 0;
         double min_lon_ = 0;
@@ -55,23 +108,62 @@ namespace render {
         svg::Document GetDocument() const;
         void SetSettings(const Settings& settings);
         Settings GetSettings() const;
+        //Fits the map to the stops and projects them once for all layers
         void SetBorder(const Stops& stops);
         void SetBusRoute(const Buses& buses);
         void SetStation(const Stops& stops);
 
+        //Fits the map to the viewport instead of SetBorder, labels outside of it are skipped
+        void SetViewport(const Viewport& viewport);
+        //Routes sorted by name
+        void SetVisibleBusRoutes(const std::vector<VisibleRoute>& routes);
+
+        //Required when simplify_tolerance is set, must outlive the renderer
+        void SetRouteTolerances(const RouteTolerances& tolerances);
+
     private:
+        //Part of the map drawn over the previous layers
+        struct Layer {
+            size_t size = 0;
+            //rendered in one piece on one thread, in order with the other serial layers
+            bool is_serial = false;
+            std::function<void(size_t begin, size_t end, svg::Document& document)> render;
+        };
+
+        static constexpr size_t MIN_ITEMS_PER_TASK = 256;
+
         SphereProjector sphere_projector_;
         Settings settings_;
-        size_t index_color_ = 0;
         svg::Document document_;
+        //points of the stops passed to SetBorder, indexed by stop id
+        std::vector<svg::Point> projected_stops_;
+        std::vector<bool> is_projected_;
+        std::optional<Viewport> viewport_;
+        const RouteTolerances* route_tolerances_ = nullptr;
+        //bus names are placed before stop names and win collisions
+        std::optional<LabelPlacer> label_placer_;
+
+        /*Chunks of non-serial layers are rendered on worker threads into their
+        own documents, which are appended to the map in the order of layers*/
+        void RenderLayers(const std::vector<Layer>& layers);
 
-        void RenderBusRoute(const Bus& bus);
-        void RenderBusRouteName(const Bus& bus);
-        void RenderStation(const Stop& stop);
-        void RenderStationName(const Stop& stop);
+        void RenderBusRoute(const Bus& bus, const svg::Color& color, svg::Document& document) const;
+        void RenderBusRoute(const Bus& bus, size_t first_segment, size_t last_segment,
+            const svg::Color& color, svg::Document& document) const;
+        /*Draws every shared or repeated segment once, by the last route that passes it,
+        it covers the others anyway. Remaining runs are simplified by tolerances*/
+        void RenderSimplifiedBusRoutes(const std::vector<VisibleRoute>& routes, svg::Document& document) const;
+        const svg::Color& GetColor(size_t color_index) const;
+        //Not const: labels may be placed
+        void RenderBusRouteName(const Bus& bus, const svg::Color& color, svg::Document& document);
+        void RenderStation(const Stop& stop, svg::Document& document) const;
+        void RenderStationName(const Stop& stop, svg::Document& document);
         svg::Polyline CreateBusRoute(const Bus& bus) const;
-        svg::Color GetColor();
-        svg::Point GetPoint(const tg::detail::Coordinates& coords) const;
-        size_t GetIndexColor();
+        svg::Polyline CreateBusRoute(const Bus& bus, size_t first_segment, size_t last_segment) const;
+        bool IsVisible(const tg::detail::Coordinates& coords) const;
+        //Visible and, if labels are culled, doesn't overlap placed labels
+        bool TryPlaceLabel(svg::Point position, svg::Point offset, int font_size, double width_factor,
+            const std::string& data);
+        svg::Point GetPoint(const Stop& stop) const;
     };
 }
\ No newline at end of file
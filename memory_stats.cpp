@@ -0,0 +1,232 @@
+#include "memory_stats.h"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+
+namespace memory {
+
+    namespace {
+        struct Counters {
+            std::atomic<uint64_t> allocations{ 0 };
+            std::atomic<uint64_t> deallocations{ 0 };
+            std::atomic<uint64_t> allocated_bytes{ 0 };
+            std::atomic<uint64_t> live_bytes{ 0 };
+            std::atomic<uint64_t> peak_bytes{ 0 };
+        };
+
+        //Plain static storage: it must be usable before main and after any destructor
+        std::array<Counters, static_cast<size_t>(Subsystem::COUNT)> subsystems;
+        Counters total;
+        std::atomic<uint64_t> zero_allocation_violations{ 0 };
+
+        thread_local Subsystem current_subsystem = Subsystem::OTHER;
+        thread_local uint64_t thread_allocations = 0;
+
+        void UpdatePeak(std::atomic<uint64_t>& peak, uint64_t value) {
+            uint64_t current = peak.load(std::memory_order_relaxed);
+            while (value > current
+                && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        [[maybe_unused]] void CountAllocation(Counters& counters, uint64_t size) {
+            counters.allocations.fetch_add(1, std::memory_order_relaxed);
+            counters.allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+            const uint64_t live = counters.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+            UpdatePeak(counters.peak_bytes, live);
+        }
+
+        [[maybe_unused]] void CountDeallocation(Counters& counters, uint64_t size) {
+            counters.deallocations.fetch_add(1, std::memory_order_relaxed);
+            counters.live_bytes.fetch_sub(size, std::memory_order_relaxed);
+        }
+
+        SubsystemSnapshot MakeSnapshot(std::string_view name, const Counters& counters) {
+            return { name,
+                counters.allocations.load(std::memory_order_relaxed),
+                counters.deallocations.load(std::memory_order_relaxed),
+                counters.allocated_bytes.load(std::memory_order_relaxed),
+                counters.live_bytes.load(std::memory_order_relaxed),
+                counters.peak_bytes.load(std::memory_order_relaxed) };
+        }
+    }
+
+#ifdef TG_MEMORY_STATS
+    namespace detail {
+        //Stored before every block, keeps malloc alignment
+        struct alignas(alignof(std::max_align_t)) Header {
+            uint64_t size;
+            Subsystem subsystem;
+        };
+
+        void* Allocate(std::size_t size) {
+            void* block = std::malloc(sizeof(Header) + size);
+            if (block == nullptr) {
+                return nullptr;
+            }
+            Header* header = static_cast<Header*>(block);
+            header->size = size;
+            header->subsystem = current_subsystem;
+            ++thread_allocations;
+            CountAllocation(subsystems[static_cast<size_t>(header->subsystem)], size);
+            CountAllocation(total, size);
+            return header + 1;
+        }
+
+        void Deallocate(void* ptr) {
+            if (ptr == nullptr) {
+                return;
+            }
+            Header* header = static_cast<Header*>(ptr) - 1;
+            CountDeallocation(subsystems[static_cast<size_t>(header->subsystem)], header->size);
+            CountDeallocation(total, header->size);
+            std::free(header);
+        }
+    }
+#endif
+
+    std::string_view GetSubsystemName(Subsystem subsystem) {
+        using namespace std::literals;
+        switch (subsystem) {
+        case Subsystem::OTHER:
+            return "other"sv;
+        case Subsystem::JSON_DOM:
+            return "json dom"sv;
+        case Subsystem::CATALOGUE:
+            return "catalogue"sv;
+        case Subsystem::DISTANCE_TABLE:
+            return "distance table"sv;
+        case Subsystem::SVG_DOCUMENT:
+            return "svg document"sv;
+        case Subsystem::COUNT:
+            break;
+        }
+        return "unknown"sv;
+    }
+
+    bool IsEnabled() {
+#ifdef TG_MEMORY_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    SubsystemSnapshot GetSnapshot(Subsystem subsystem) {
+        return MakeSnapshot(GetSubsystemName(subsystem), subsystems[static_cast<size_t>(subsystem)]);
+    }
+
+    uint64_t GetLiveBytes() {
+        return total.live_bytes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetPeakBytes() {
+        return total.peak_bytes.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetThreadAllocations() {
+        return thread_allocations;
+    }
+
+    Subsystem GetCurrentSubsystem() {
+        return current_subsystem;
+    }
+
+    void Dump(std::ostream& output) {
+        if (!IsEnabled()) {
+            output << "memory accounting is off, build with TG_MEMORY_STATS defined\n";
+            return;
+        }
+        auto print = [&output](const SubsystemSnapshot& snapshot) {
+            output << std::left << std::setw(16) << snapshot.name << std::right
+                << std::setw(14) << snapshot.allocations << std::setw(14) << snapshot.deallocations
+                << std::setw(16) << snapshot.allocated_bytes << std::setw(14) << snapshot.live_bytes
+                << std::setw(14) << snapshot.peak_bytes << '\n';
+        };
+        output << std::left << std::setw(16) << "subsystem" << std::right
+            << std::setw(14) << "allocations" << std::setw(14) << "frees"
+            << std::setw(16) << "total_bytes" << std::setw(14) << "live_bytes"
+            << std::setw(14) << "peak_bytes" << '\n';
+        for (size_t i = 0; i < subsystems.size(); ++i) {
+            print(GetSnapshot(static_cast<Subsystem>(i)));
+        }
+        using namespace std::literals;
+        print(MakeSnapshot("total"sv, total));
+        output << "zero allocation scope violations: "
+            << zero_allocation_violations.load(std::memory_order_relaxed) << '\n';
+    }
+
+    // ---------- Scope ------------------
+
+    Scope::Scope(Subsystem subsystem)
+        : previous_(current_subsystem) {
+        current_subsystem = subsystem;
+    }
+
+    Scope::~Scope() {
+        current_subsystem = previous_;
+    }
+
+    // ---------- ZeroAllocationScope ------------------
+
+    ZeroAllocationScope::ZeroAllocationScope()
+        : allocations_at_start_(thread_allocations) {
+    }
+
+    ZeroAllocationScope::~ZeroAllocationScope() {
+        if (thread_allocations != allocations_at_start_) {
+            zero_allocation_violations.fetch_add(1, std::memory_order_relaxed);
+            assert(!"heap allocation inside ZeroAllocationScope");
+        }
+    }
+}
+
+#ifdef TG_MEMORY_STATS
+void* operator new(std::size_t size) {
+    if (void* ptr = memory::detail::Allocate(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return memory::detail::Allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return memory::detail::Allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    memory::detail::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    memory::detail::Deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    memory::detail::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    memory::detail::Deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    memory::detail::Deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    memory::detail::Deallocate(ptr);
+}
+#endif
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+
+/*Heap allocation accounting by subsystem.
+Global operator new/delete are replaced only when the program is built
+with TG_MEMORY_STATS defined, otherwise every counter stays zero and
+scopes cost nothing but a thread local store*/
+namespace memory {
+
+    enum class Subsystem {
+        OTHER,
+        JSON_DOM,
+        CATALOGUE,
+        DISTANCE_TABLE,
+        SVG_DOCUMENT,
+        COUNT,
+    };
+
+    std::string_view GetSubsystemName(Subsystem subsystem);
+
+    bool IsEnabled();
+
+    struct SubsystemSnapshot {
+        std::string_view name;
+        uint64_t allocations = 0;
+        uint64_t deallocations = 0;
+        uint64_t allocated_bytes = 0;
+        uint64_t live_bytes = 0;
+        uint64_t peak_bytes = 0;
+    };
+
+    SubsystemSnapshot GetSnapshot(Subsystem subsystem);
+
+    //Live and peak bytes of all subsystems together
+    uint64_t GetLiveBytes();
+    uint64_t GetPeakBytes();
+
+    //Number of allocations made by the current thread
+    uint64_t GetThreadAllocations();
+
+    //Subsystem of the innermost scope of the current thread
+    Subsystem GetCurrentSubsystem();
+
+    void Dump(std::ostream& output);
+
+    //Allocations inside the scope are counted to the subsystem,
+    //memory is credited back to the same subsystem when freed
+    class Scope {
+    public:
+        explicit Scope(Subsystem subsystem);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Subsystem previous_;
+    };
+
+    /*Checks that the scope doesn't allocate. With TG_MEMORY_STATS
+    violations are counted in Dump and fail assert in debug builds*/
+    class ZeroAllocationScope {
+    public:
+        ZeroAllocationScope();
+        ~ZeroAllocationScope();
+
+        ZeroAllocationScope(const ZeroAllocationScope&) = delete;
+        ZeroAllocationScope& operator=(const ZeroAllocationScope&) = delete;
+
+    private:
+        uint64_t allocations_at_start_;
+    };
+}
@@ -0,0 +1,206 @@
+#include "metrics.h"
+#include "bit_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace metrics {
+
+    namespace {
+        struct ProbeStat {
+            LatencyHistogram latency;
+            std::atomic<uint64_t> errors{ 0 };
+        };
+
+        std::array<ProbeStat, static_cast<size_t>(Probe::COUNT)>& GetProbes() {
+            static std::array<ProbeStat, static_cast<size_t>(Probe::COUNT)> probes;
+            return probes;
+        }
+
+        double ToMicroseconds(uint64_t nanoseconds) {
+            return nanoseconds / 1000.0;
+        }
+    }
+
+    std::string_view GetProbeName(Probe probe) {
+        using namespace std::literals;
+        switch (probe) {
+        case Probe::JSON_LOAD:
+            return "json::Load"sv;
+        case Probe::BASE_STOPS:
+            return "BaseRequestsStops"sv;
+        case Probe::BASE_DISTANCES:
+            return "BaseRequestsDistances"sv;
+        case Probe::BASE_BUSES:
+            return "BaseRequestsBuses"sv;
+        case Probe::BASE_RENDER_SETTINGS:
+            return "BaseRequestsRenderSettings"sv;
+        case Probe::BASE_ROUTER:
+            return "BuildRouter"sv;
+        case Probe::DELTA:
+            return "DeltaRequests"sv;
+        case Probe::STAT_STOP:
+            return "Stop"sv;
+        case Probe::STAT_BUS:
+            return "Bus"sv;
+        case Probe::STAT_STOPS:
+            return "Stops"sv;
+        case Probe::STAT_BUSES:
+            return "Buses"sv;
+        case Probe::STAT_MAP:
+            return "Map"sv;
+        case Probe::STAT_MAP_VIEWPORT:
+            return "MapViewport"sv;
+        case Probe::STAT_NEAREST_STOPS:
+            return "NearestStops"sv;
+        case Probe::STAT_STOPS_IN_RADIUS:
+            return "StopsInRadius"sv;
+        case Probe::STAT_ROUTE:
+            return "Route"sv;
+        case Probe::STAT_ROUTE_HIERARCHY:
+            return "RouteHierarchy"sv;
+        case Probe::STAT_DISTANCE_MATRIX:
+            return "DistanceMatrix"sv;
+        case Probe::STAT_REACHABLE:
+            return "Reachable"sv;
+        case Probe::STAT_DIRECT_BUSES:
+            return "DirectBuses"sv;
+        case Probe::STAT_TRANSFER_STOPS:
+            return "TransferStops"sv;
+        case Probe::STAT_SUGGEST:
+            return "Suggest"sv;
+        case Probe::STAT_LONGEST_BUSES:
+            return "LongestBuses"sv;
+        case Probe::STAT_CURVED_BUSES:
+            return "CurvedBuses"sv;
+        case Probe::STAT_BUSIEST_STOPS:
+            return "BusiestStops"sv;
+        case Probe::COUNT:
+            break;
+        }
+        return "unknown"sv;
+    }
+
+    // ---------- LatencyHistogram ------------------
+
+    size_t LatencyHistogram::GetBucketIndex(uint64_t value) {
+        if (value < LINEAR_BUCKETS) {
+            return value;
+        }
+        const int msb = bits::GetMostSignificantBit(value);
+        const int shift = msb - SUB_BUCKET_BITS;
+        const uint64_t sub_bucket = (value >> shift) - SUB_BUCKETS;
+        return LINEAR_BUCKETS + (msb - SUB_BUCKET_BITS - 1) * SUB_BUCKETS + sub_bucket;
+    }
+
+    uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+        if (index < LINEAR_BUCKETS) {
+            return index;
+        }
+        const int msb = (index - LINEAR_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS + 1;
+        const uint64_t top = (index - LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+        const int shift = msb - SUB_BUCKET_BITS;
+        return ((top + 1) << shift) - 1;
+    }
+
+    void LatencyHistogram::Record(uint64_t nanoseconds) {
+        buckets_[GetBucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (nanoseconds > max
+            && !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t LatencyHistogram::GetCount() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::GetMax() const {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::GetTotal() const {
+        return total_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+        const uint64_t count = GetCount();
+        if (count == 0) {
+            return 0;
+        }
+        //Nearest rank, the first value has rank 1
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile / 100.0 * count)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(GetBucketUpperBound(i), GetMax());
+            }
+        }
+        return GetMax();
+    }
+
+    // ---------- Probes ------------------
+
+    void Record(Probe probe, std::chrono::nanoseconds duration, bool is_error) {
+        auto& stat = GetProbes()[static_cast<size_t>(probe)];
+        stat.latency.Record(duration.count() > 0 ? duration.count() : 0);
+        if (is_error) {
+            stat.errors.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::vector<ProbeSnapshot> GetSnapshot() {
+        std::vector<ProbeSnapshot> result;
+        for (size_t i = 0; i < static_cast<size_t>(Probe::COUNT); ++i) {
+            const auto& stat = GetProbes()[i];
+            const uint64_t count = stat.latency.GetCount();
+            if (count == 0) {
+                continue;
+            }
+            result.push_back({
+                GetProbeName(static_cast<Probe>(i)),
+                count,
+                stat.errors.load(std::memory_order_relaxed),
+                ToMicroseconds(stat.latency.GetTotal()) / count,
+                ToMicroseconds(stat.latency.GetPercentile(50)),
+                ToMicroseconds(stat.latency.GetPercentile(90)),
+                ToMicroseconds(stat.latency.GetPercentile(99)),
+                ToMicroseconds(stat.latency.GetMax()) });
+        }
+        return result;
+    }
+
+    void Dump(std::ostream& output) {
+        output << std::left << std::setw(28) << "probe" << std::right
+            << std::setw(10) << "count" << std::setw(10) << "errors"
+            << std::setw(12) << "mean_us" << std::setw(12) << "p50_us"
+            << std::setw(12) << "p90_us" << std::setw(12) << "p99_us"
+            << std::setw(12) << "max_us" << '\n';
+        for (const auto& probe : GetSnapshot()) {
+            output << std::left << std::setw(28) << probe.name << std::right
+                << std::setw(10) << probe.count << std::setw(10) << probe.errors
+                << std::setw(12) << probe.mean_us << std::setw(12) << probe.p50_us
+                << std::setw(12) << probe.p90_us << std::setw(12) << probe.p99_us
+                << std::setw(12) << probe.max_us << '\n';
+        }
+    }
+
+    // ---------- ScopedTimer ------------------
+
+    ScopedTimer::ScopedTimer(Probe probe)
+        : probe_(probe)
+        , start_(std::chrono::steady_clock::now()) {
+    }
+
+    ScopedTimer::~ScopedTimer() {
+        Record(probe_, std::chrono::steady_clock::now() - start_, is_error_);
+    }
+
+    void ScopedTimer::SetError(bool is_error) {
+        is_error_ = is_error;
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace metrics {
+
+    //Measured phases and requests
+    enum class Probe {
+        JSON_LOAD,
+        BASE_STOPS,
+        BASE_DISTANCES,
+        BASE_BUSES,
+        BASE_RENDER_SETTINGS,
+        BASE_ROUTER,
+        DELTA,
+        STAT_STOP,
+        STAT_BUS,
+        STAT_STOPS,
+        STAT_BUSES,
+        STAT_MAP,
+        STAT_MAP_VIEWPORT,
+        STAT_NEAREST_STOPS,
+        STAT_STOPS_IN_RADIUS,
+        STAT_ROUTE,
+        STAT_ROUTE_HIERARCHY,
+        STAT_DISTANCE_MATRIX,
+        STAT_REACHABLE,
+        STAT_DIRECT_BUSES,
+        STAT_TRANSFER_STOPS,
+        STAT_SUGGEST,
+        STAT_LONGEST_BUSES,
+        STAT_CURVED_BUSES,
+        STAT_BUSIEST_STOPS,
+        COUNT,
+    };
+
+    std::string_view GetProbeName(Probe probe);
+
+    /*Latency histogram with logarithmic buckets, every power of two
+    is split into 8 linear sub-buckets, so relative error is below 12.5%.
+    Recording is lock free and can be done from several threads*/
+    class LatencyHistogram {
+    public:
+        void Record(uint64_t nanoseconds);
+
+        uint64_t GetCount() const;
+        uint64_t GetMax() const;
+        uint64_t GetTotal() const;
+        //Upper bound of the bucket that holds given percentile (0..100)
+        uint64_t GetPercentile(double percentile) const;
+
+    private:
+        static constexpr int SUB_BUCKET_BITS = 3;
+        static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr int LINEAR_BUCKETS = SUB_BUCKETS * 2;
+        static constexpr int BUCKETS = LINEAR_BUCKETS + (64 - SUB_BUCKET_BITS - 1) * SUB_BUCKETS;
+
+        static size_t GetBucketIndex(uint64_t value);
+        static uint64_t GetBucketUpperBound(size_t index);
+
+        std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+        std::atomic<uint64_t> count_{ 0 };
+        std::atomic<uint64_t> total_{ 0 };
+        std::atomic<uint64_t> max_{ 0 };
+    };
+
+    struct ProbeSnapshot {
+        std::string_view name;
+        uint64_t count = 0;
+        uint64_t errors = 0;
+        double mean_us = 0;
+        double p50_us = 0;
+        double p90_us = 0;
+        double p99_us = 0;
+        double max_us = 0;
+    };
+
+    void Record(Probe probe, std::chrono::nanoseconds duration, bool is_error = false);
+
+    //Only probes that were recorded at least once
+    std::vector<ProbeSnapshot> GetSnapshot();
+
+    void Dump(std::ostream& output);
+
+    //Measures time of the scope and records it to the probe
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Probe probe);
+        ~ScopedTimer();
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+        //Counts the measurement as error ("not found" answer)
+        void SetError(bool is_error = true);
+
+    private:
+        Probe probe_;
+        bool is_error_ = false;
+        std::chrono::steady_clock::time_point start_;
+    };
+}
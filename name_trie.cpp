@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+#include "name_trie.h"
+
+namespace tg {
+
+	namespace {
+		//Bytes that are not valid UTF-8 are taken as code points of their own
+		std::vector<char32_t> DecodeUtf8(std::string_view text) {
+			std::vector<char32_t> result;
+			result.reserve(text.size());
+			for (size_t i = 0; i < text.size();) {
+				const unsigned char lead = static_cast<unsigned char>(text[i]);
+				size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+				char32_t code_point = length == 1 ? lead : length == 2 ? lead & 0x1F : length == 3 ? lead & 0x0F : lead & 0x07;
+				for (size_t j = 1; j < length; ++j) {
+					const unsigned char next = i + j < text.size() ? static_cast<unsigned char>(text[i + j]) : 0;
+					if ((next >> 6) != 0x2) {
+						length = 0;
+						break;
+					}
+					code_point = (code_point << 6) | (next & 0x3F);
+				}
+				if (length == 0) {
+					result.push_back(lead);
+					++i;
+					continue;
+				}
+				result.push_back(code_point);
+				i += length;
+			}
+			return result;
+		}
+	}
+
+	struct NameTrie::Collector {
+		Collector(const std::vector<Entry>& entries, size_t limit, int max_errors)
+			: entries(entries), limit(limit), by_errors(max_errors + 1) {
+		}
+
+		//Nothing with that many errors can get into the answer any more
+		bool IsFull(int errors) const {
+			size_t count = 0;
+			for (int i = 0; i <= errors && i < static_cast<int>(by_errors.size()); ++i) {
+				count += by_errors[i].size();
+			}
+			return count >= limit;
+		}
+
+		void Add(int32_t entry, int errors) {
+			by_errors[errors].push_back({ entries[entry].name, entries[entry].stop, entries[entry].bus, errors });
+		}
+
+		const std::vector<Entry>& entries;
+		size_t limit;
+		//every group is sorted by name as subtrees are walked in that order
+		std::vector<std::vector<Suggestion>> by_errors;
+	};
+
+	NameTrie::NameTrie(const TransportGuide& guide) {
+		std::unordered_map<std::string_view, size_t> entry_indexes;
+		auto find_entry = [this, &entry_indexes](std::string_view name) -> Entry& {
+			auto [position, is_new] = entry_indexes.emplace(name, entries_.size());
+			if (is_new) {
+				entries_.push_back({ name, nullptr, nullptr });
+			}
+			return entries_[position->second];
+		};
+		for (const Stop* stop : guide.GetSortedStops()) {
+			find_entry(stop->name).stop = stop;
+		}
+		for (const Bus* bus : guide.GetSortedBuses()) {
+			find_entry(bus->name).bus = bus;
+		}
+
+		std::vector<std::vector<char32_t>> code_points;
+		code_points.reserve(entries_.size());
+		for (const Entry& entry : entries_) {
+			code_points.push_back(DecodeUtf8(entry.name));
+			alphabet_.insert(alphabet_.end(), code_points.back().begin(), code_points.back().end());
+			max_length_ = std::max(max_length_, code_points.back().size());
+		}
+		std::sort(alphabet_.begin(), alphabet_.end());
+		alphabet_.erase(std::unique(alphabet_.begin(), alphabet_.end()), alphabet_.end());
+
+		//entries are kept in order of keys, the order of letters is the order of code points
+		std::vector<std::vector<Letter>> keys(entries_.size());
+		for (size_t i = 0; i < entries_.size(); ++i) {
+			keys[i].reserve(code_points[i].size());
+			for (char32_t code_point : code_points[i]) {
+				keys[i].push_back(static_cast<Letter>(std::lower_bound(alphabet_.begin(), alphabet_.end(), code_point) - alphabet_.begin() + 1));
+			}
+		}
+		std::vector<size_t> order(entries_.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&keys](size_t lhs, size_t rhs) {
+			return keys[lhs] < keys[rhs];
+		});
+		std::vector<std::vector<Letter>> sorted_keys;
+		std::vector<Entry> sorted_entries;
+		sorted_keys.reserve(order.size());
+		sorted_entries.reserve(order.size());
+		for (size_t index : order) {
+			sorted_keys.push_back(std::move(keys[index]));
+			sorted_entries.push_back(entries_[index]);
+		}
+		entries_ = std::move(sorted_entries);
+
+		base_.assign(1, 0);
+		check_.assign(1, 0);
+		terminal_.assign(1, -1);
+		first_child_.assign(1, NO_LETTER);
+		next_sibling_.assign(1, NO_LETTER);
+		Build(0, sorted_keys, 0, sorted_keys.size(), 0);
+	}
+
+	void NameTrie::Build(int32_t node, const std::vector<std::vector<Letter>>& keys, size_t begin, size_t end, size_t depth) {
+		//keys are unique, so only the first one can end here
+		if (begin < end && keys[begin].size() == depth) {
+			terminal_[node] = static_cast<int32_t>(begin);
+			++begin;
+		}
+		if (begin == end) {
+			return;
+		}
+
+		std::vector<Letter> letters;
+		std::vector<size_t> group_begins;
+		for (size_t i = begin; i < end; ++i) {
+			if (letters.empty() || letters.back() != keys[i][depth]) {
+				letters.push_back(keys[i][depth]);
+				group_begins.push_back(i);
+			}
+		}
+		group_begins.push_back(end);
+
+		const int32_t base = FindBase(letters);
+		base_[node] = base;
+		first_child_[node] = letters.front();
+		for (size_t i = 0; i < letters.size(); ++i) {
+			check_[base + letters[i]] = node;
+			next_sibling_[base + letters[i]] = i + 1 < letters.size() ? letters[i + 1] : NO_LETTER;
+		}
+		while (first_free_ < check_.size() && check_[first_free_] != -1) {
+			++first_free_;
+		}
+		for (size_t i = 0; i < letters.size(); ++i) {
+			Build(base + letters[i], keys, group_begins[i], group_begins[i + 1], depth + 1);
+		}
+	}
+
+	int32_t NameTrie::FindBase(const std::vector<Letter>& letters) {
+		size_t base = first_free_ > letters.front() ? first_free_ - letters.front() : 0;
+		while (true) {
+			Reserve(base + letters.back() + 1);
+			const bool is_free = std::all_of(letters.begin(), letters.end(), [this, base](Letter letter) {
+				return check_[base + letter] == -1;
+			});
+			if (is_free) {
+				return static_cast<int32_t>(base);
+			}
+			++base;
+		}
+	}
+
+	void NameTrie::Reserve(size_t size) {
+		if (check_.size() < size) {
+			base_.resize(size, 0);
+			check_.resize(size, -1);
+			terminal_.resize(size, -1);
+			first_child_.resize(size, NO_LETTER);
+			next_sibling_.resize(size, NO_LETTER);
+		}
+	}
+
+	void NameTrie::TakeSlot(size_t slot, int32_t parent) {
+		check_[slot] = parent;
+		base_[slot] = 0;
+		terminal_[slot] = -1;
+		first_child_[slot] = NO_LETTER;
+		next_sibling_[slot] = NO_LETTER;
+		while (first_free_ < check_.size() && check_[first_free_] != -1) {
+			++first_free_;
+		}
+	}
+
+	void NameTrie::FreeSlot(size_t slot) {
+		check_[slot] = -1;
+		base_[slot] = 0;
+		terminal_[slot] = -1;
+		first_child_[slot] = NO_LETTER;
+		next_sibling_[slot] = NO_LETTER;
+		first_free_ = std::min(first_free_, slot);
+	}
+
+	int32_t NameTrie::AddChild(int32_t node, Letter letter) {
+		if (first_child_[node] == NO_LETTER) {
+			base_[node] = FindBase({ letter });
+		}
+		else if (const size_t slot = static_cast<size_t>(base_[node]) + letter; slot < check_.size() && check_[slot] != -1) {
+			//the slot belongs to another node, children are moved where all of them and the new one fit
+			std::vector<Letter> letters;
+			for (Letter child = first_child_[node]; child != NO_LETTER; child = next_sibling_[base_[node] + child]) {
+				letters.push_back(child);
+			}
+			std::vector<Letter> new_letters = letters;
+			new_letters.insert(std::upper_bound(new_letters.begin(), new_letters.end(), letter), letter);
+			const int32_t new_base = FindBase(new_letters);
+			for (Letter child : letters) {
+				const size_t from = static_cast<size_t>(base_[node]) + child;
+				const size_t to = static_cast<size_t>(new_base) + child;
+				check_[to] = node;
+				base_[to] = base_[from];
+				terminal_[to] = terminal_[from];
+				first_child_[to] = first_child_[from];
+				next_sibling_[to] = next_sibling_[from];
+				for (Letter grandchild = first_child_[from]; grandchild != NO_LETTER;
+					grandchild = next_sibling_[base_[from] + grandchild]) {
+					check_[base_[from] + grandchild] = static_cast<int32_t>(to);
+				}
+				FreeSlot(from);
+			}
+			base_[node] = new_base;
+		}
+
+		const size_t slot = static_cast<size_t>(base_[node]) + letter;
+		Reserve(slot + 1);
+		TakeSlot(slot, node);
+		//children stay linked in order of letters
+		Letter* link = &first_child_[node];
+		while (*link != NO_LETTER && *link < letter) {
+			link = &next_sibling_[base_[node] + *link];
+		}
+		next_sibling_[slot] = *link;
+		*link = letter;
+		return static_cast<int32_t>(slot);
+	}
+
+	void NameTrie::RemoveChild(int32_t node, Letter letter) {
+		Letter* link = &first_child_[node];
+		while (*link != letter) {
+			link = &next_sibling_[base_[node] + *link];
+		}
+		const size_t slot = static_cast<size_t>(base_[node]) + letter;
+		*link = next_sibling_[slot];
+		FreeSlot(slot);
+	}
+
+	void NameTrie::SetEntry(std::string_view name, const Stop* stop, const Bus* bus) {
+		const std::vector<Letter> letters = ToLetters(name);
+		int32_t node = 0;
+		if (stop == nullptr && bus == nullptr) {
+			for (size_t i = 0; i < letters.size() && node != -1; ++i) {
+				node = FindChild(node, letters[i]);
+			}
+			if (node == -1 || terminal_[node] == -1) {
+				return;
+			}
+			entries_[terminal_[node]] = {};
+			free_entries_.push_back(terminal_[node]);
+			terminal_[node] = -1;
+			//nodes left without names below them are pruned
+			while (node != 0 && terminal_[node] == -1 && first_child_[node] == NO_LETTER) {
+				const int32_t parent = check_[node];
+				RemoveChild(parent, static_cast<Letter>(node - base_[parent]));
+				node = parent;
+			}
+			return;
+		}
+
+		for (Letter letter : letters) {
+			const int32_t child = FindChild(node, letter);
+			node = child != -1 ? child : AddChild(node, letter);
+		}
+		if (terminal_[node] == -1) {
+			if (free_entries_.empty()) {
+				terminal_[node] = static_cast<int32_t>(entries_.size());
+				entries_.emplace_back();
+			}
+			else {
+				terminal_[node] = free_entries_.back();
+				free_entries_.pop_back();
+			}
+		}
+		//the name is viewed in the stop or the bus that keep it
+		entries_[terminal_[node]] = { stop != nullptr ? std::string_view(stop->name) : std::string_view(bus->name), stop, bus };
+		max_length_ = std::max(max_length_, letters.size());
+	}
+
+	void NameTrie::Update(const TransportGuide& guide, const CatalogueChanges& changes) {
+		std::vector<std::string_view> names(changes.buses.begin(), changes.buses.end());
+		names.insert(names.end(), changes.stops.begin(), changes.stops.end());
+		for (std::string_view name : names) {
+			const std::vector<Letter> letters = ToLetters(name);
+			if (std::find(letters.begin(), letters.end(), NO_LETTER) != letters.end()) {
+				//letters are numbered in order of code points, a new one renumbers them all
+				*this = NameTrie(guide);
+				return;
+			}
+		}
+		for (std::string_view name : names) {
+			const std::string key(name);
+			SetEntry(name, guide.FindStop(key), guide.FindBus(key));
+		}
+	}
+
+	std::vector<NameTrie::Letter> NameTrie::ToLetters(std::string_view name) const {
+		std::vector<Letter> result;
+		for (char32_t code_point : DecodeUtf8(name)) {
+			auto position = std::lower_bound(alphabet_.begin(), alphabet_.end(), code_point);
+			result.push_back(position != alphabet_.end() && *position == code_point
+				? static_cast<Letter>(position - alphabet_.begin() + 1) : NO_LETTER);
+		}
+		return result;
+	}
+
+	int32_t NameTrie::FindChild(int32_t node, Letter letter) const {
+		if (letter == NO_LETTER) {
+			return -1;
+		}
+		const size_t slot = static_cast<size_t>(base_[node]) + letter;
+		return slot < check_.size() && check_[slot] == node ? static_cast<int32_t>(slot) : -1;
+	}
+
+	bool NameTrie::CollectSubtree(int32_t node, int errors, Collector& collector) const {
+		if (collector.IsFull(errors)) {
+			return false;
+		}
+		if (terminal_[node] != -1) {
+			collector.Add(terminal_[node], errors);
+		}
+		for (Letter letter = first_child_[node]; letter != NO_LETTER; letter = next_sibling_[base_[node] + letter]) {
+			if (!CollectSubtree(base_[node] + letter, errors, collector)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void NameTrie::CollectFuzzy(int32_t node, const std::vector<Letter>& prefix, std::vector<int>& rows, size_t depth,
+		int best, int max_errors, Collector& collector) const {
+		//row of edit distances between prefixes of the query and the path to the node
+		const size_t width = prefix.size() + 1;
+		const int* row = rows.data() + depth * width;
+		best = std::min(best, row[prefix.size()]);
+		//minimum of the row never falls on the way down, so nothing below can be better
+		const int bound = std::min(best, *std::min_element(row, row + width));
+		if (bound > max_errors || collector.IsFull(bound)) {
+			return;
+		}
+		if (bound == best) {
+			CollectSubtree(node, best, collector);
+			return;
+		}
+		if (terminal_[node] != -1 && best <= max_errors) {
+			collector.Add(terminal_[node], best);
+		}
+		for (Letter letter = first_child_[node]; letter != NO_LETTER; letter = next_sibling_[base_[node] + letter]) {
+			int* next = rows.data() + (depth + 1) * width;
+			next[0] = row[0] + 1;
+			for (size_t j = 1; j < width; ++j) {
+				next[j] = std::min({ row[j] + 1, next[j - 1] + 1, row[j - 1] + (prefix[j - 1] != letter ? 1 : 0) });
+			}
+			CollectFuzzy(base_[node] + letter, prefix, rows, depth + 1, best, max_errors, collector);
+		}
+	}
+
+	std::vector<Suggestion> NameTrie::Suggest(std::string_view prefix, size_t limit, int max_errors) const {
+		const std::vector<Letter> letters = ToLetters(prefix);
+		//the prefix is at most its length of letters away from any name
+		max_errors = static_cast<int>(std::clamp<int64_t>(max_errors, 0, static_cast<int64_t>(letters.size())));
+		Collector collector(entries_, limit, max_errors);
+		if (max_errors <= 0) {
+			int32_t node = 0;
+			for (size_t i = 0; i < letters.size() && node != -1; ++i) {
+				node = FindChild(node, letters[i]);
+			}
+			if (node != -1) {
+				CollectSubtree(node, 0, collector);
+			}
+		}
+		else {
+			const size_t width = letters.size() + 1;
+			std::vector<int> rows((max_length_ + 1) * width);
+			std::iota(rows.begin(), rows.begin() + width, 0);
+			CollectFuzzy(0, letters, rows, 0, static_cast<int>(width), max_errors, collector);
+		}
+
+		std::vector<Suggestion> result;
+		for (auto& group : collector.by_errors) {
+			for (Suggestion& suggestion : group) {
+				if (result.size() == limit) {
+					return result;
+				}
+				result.push_back(suggestion);
+			}
+		}
+		return result;
+	}
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "domain.h"
+#include "transport_catalogue.h"
+
+namespace tg {
+
+	//Stop and bus sharing a name share one suggestion
+	struct Suggestion {
+		std::string_view name;
+		const Stop* stop = nullptr;
+		const Bus* bus = nullptr;
+		//edit distance between the prefix and the closest prefix of the name
+		int errors = 0;
+	};
+
+	/*Double-array trie over names of stops and buses. Names are decoded from
+	UTF-8 and letters are renumbered by the alphabet of the catalogue, so
+	children of node s are s' = base_[s] + letter with check_[s'] == s and edit
+	distances are counted in letters, not bytes. Children are also linked per
+	node in order of letters to walk subtrees in order of names. Names of
+	changed stops and buses are inserted and erased in place, a node whose new
+	child collides with another node moves its children to a free base*/
+	class NameTrie {
+	public:
+		explicit NameTrie(const TransportGuide& guide);
+
+		//Names with letters out of the alphabet make the trie built again
+		void Update(const TransportGuide& guide, const CatalogueChanges& changes);
+
+		/*Up to limit names starting with the prefix, sorted by name. With
+		max_errors the prefix may differ from the start of the name in that
+		many inserted, deleted or replaced letters, closer names go first*/
+		std::vector<Suggestion> Suggest(std::string_view prefix, size_t limit, int max_errors = 0) const;
+
+	private:
+		using Letter = uint32_t;
+		//letter of code points that are absent in the alphabet
+		static constexpr Letter NO_LETTER = 0;
+
+		struct Entry {
+			std::string_view name;
+			const Stop* stop = nullptr;
+			const Bus* bus = nullptr;
+		};
+
+		//Suggestions found so far, grouped by the number of errors
+		struct Collector;
+
+		std::vector<Letter> ToLetters(std::string_view name) const;
+		void Build(int32_t node, const std::vector<std::vector<Letter>>& keys, size_t begin, size_t end, size_t depth);
+		//letters must be sorted
+		int32_t FindBase(const std::vector<Letter>& letters);
+		int32_t FindChild(int32_t node, Letter letter) const;
+		//Takes the free slot for the child, the node is moved to another base if the slot is taken
+		int32_t AddChild(int32_t node, Letter letter);
+		void RemoveChild(int32_t node, Letter letter);
+		//Slots up to size exist, new ones are free
+		void Reserve(size_t size);
+		void TakeSlot(size_t slot, int32_t parent);
+		void FreeSlot(size_t slot);
+		//The name has the stop, the bus or both of them, the key is erased when it has none
+		void SetEntry(std::string_view name, const Stop* stop, const Bus* bus);
+		//Terminals of the subtree in order of names, false when the collector is full
+		bool CollectSubtree(int32_t node, int errors, Collector& collector) const;
+		void CollectFuzzy(int32_t node, const std::vector<Letter>& prefix, std::vector<int>& rows, size_t depth,
+			int best, int max_errors, Collector& collector) const;
+
+		//sorted code points, letter of alphabet_[i] is i + 1
+		std::vector<char32_t> alphabet_;
+		std::vector<int32_t> base_;
+		//parent of the slot, -1 for free slots, the root at slot 0 is its own parent
+		std::vector<int32_t> check_;
+		//entry ending in the slot or -1
+		std::vector<int32_t> terminal_;
+		//the smallest letter of children of the node and the next letter of children of its parent,
+		//NO_LETTER ends the list
+		std::vector<Letter> first_child_;
+		std::vector<Letter> next_sibling_;
+		std::vector<Entry> entries_;
+		std::vector<int32_t> free_entries_;
+		size_t max_length_ = 0;
+		//first slot that may be free
+		size_t first_free_ = 1;
+	};
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#include "memory_stats.h"
+
+namespace parallel {
+
+    //Thread count set by SetThreadCount, zero means the hardware concurrency
+    inline size_t thread_count_override = 0;
+
+    //Must be called before any parallel work starts
+    inline void SetThreadCount(size_t threads) {
+        thread_count_override = threads;
+    }
+
+    inline size_t GetThreadCount() {
+        if (thread_count_override != 0) {
+            return thread_count_override;
+        }
+        const size_t threads = std::thread::hardware_concurrency();
+        return threads == 0 ? 1 : threads;
+    }
+
+    //Number of chunks ForEachChunk splits the range into
+    inline size_t GetChunkCount(size_t size, size_t min_chunk_size) {
+        if (size == 0) {
+            return 0;
+        }
+        const size_t by_size = (size + min_chunk_size - 1) / std::max<size_t>(min_chunk_size, 1);
+        return std::max<size_t>(1, std::min(GetThreadCount(), by_size));
+    }
+
+    /*Calls func(chunk_index, begin, end) for consecutive chunks of [0, size),
+    every chunk on its own thread. Chunks are not smaller than min_chunk_size,
+    so small ranges are processed on the calling thread. Allocations of all
+    threads are counted to the memory subsystem of the calling thread.
+    The first exception thrown by func is rethrown after all threads finish*/
+    template <typename Func>
+    void ForEachChunk(size_t size, size_t min_chunk_size, Func func) {
+        const size_t chunks = GetChunkCount(size, min_chunk_size);
+        if (chunks <= 1) {
+            if (chunks == 1) {
+                func(size_t{ 0 }, size_t{ 0 }, size);
+            }
+            return;
+        }
+
+        std::vector<std::exception_ptr> errors(chunks);
+        const memory::Subsystem subsystem = memory::GetCurrentSubsystem();
+        auto run_chunk = [&](size_t chunk) {
+            memory::Scope memory_scope(subsystem);
+            try {
+                func(chunk, size * chunk / chunks, size * (chunk + 1) / chunks);
+            }
+            catch (...) {
+                errors[chunk] = std::current_exception();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(chunks - 1);
+        for (size_t chunk = 1; chunk < chunks; ++chunk) {
+            threads.emplace_back(run_chunk, chunk);
+        }
+        run_chunk(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        for (const auto& error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+}
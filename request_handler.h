@@ -13,6 +13,7 @@ public:
     RequestHandler(const tg::TransportGuide& db);
 
     std::optional<BusStatistics> GetBusStat(const std::string& bus_name) const;
+    BusStatistics GetBusStat(const Bus* bus) const;
 
 private:
     const tg::TransportGuide& db_;
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <unordered_set>
+
+#include "parallel.h"
+#include "road_graph.h"
+
+namespace tg {
+
+	namespace {
+		const double INFINITE_DISTANCE = std::numeric_limits<double>::infinity();
+		//One search can settle the whole graph, a few of them are worth a thread
+		const size_t MIN_SOURCES_PER_THREAD = 4;
+	}
+
+	RoadGraph::RoadGraph(const TransportGuide& guide) {
+		for (const Stop* stop : guide.GetSortedStops()) {
+			AddVertex(stop);
+		}
+
+		//segments of the whole routes, so non-circle routes give both directions
+		for (const Bus* bus : guide.GetSortedBuses()) {
+			for (uint32_t id : bus->segments) {
+				const RouteSegment& segment = guide.GetSegment(id);
+				if (segment.from == segment.to) {
+					continue;
+				}
+				edges_[segment.from->id].push_back({ static_cast<VertexId>(segment.to->id), static_cast<double>(segment.road_distance) });
+				++edge_count_;
+			}
+		}
+	}
+
+	void RoadGraph::AddVertex(const Stop* stop) {
+		if (stop->id >= stops_.size()) {
+			stops_.resize(stop->id + 1, nullptr);
+			edges_.resize(stop->id + 1);
+		}
+		stops_[stop->id] = stop;
+	}
+
+	void RoadGraph::Update(const TransportGuide& guide, const CatalogueChanges& changes) {
+		//removed stops had no routes, so no edges
+		for (size_t id : changes.removed_stops) {
+			if (id < stops_.size()) {
+				stops_[id] = nullptr;
+			}
+		}
+		//changed distances are used by segments of the routes going through the changed stops
+		std::unordered_set<size_t> touched(changes.old_route_stops.begin(), changes.old_route_stops.end());
+		for (const std::string& name : changes.stops) {
+			if (const Stop* stop = guide.FindStop(name)) {
+				AddVertex(stop);
+				touched.insert(stop->id);
+			}
+		}
+		for (const Bus* bus : guide.FindChangedBuses(changes)) {
+			for (const Stop* stop : bus->stops) {
+				touched.insert(stop->id);
+			}
+		}
+
+		for (size_t id : touched) {
+			if (id >= stops_.size()) {
+				continue;
+			}
+			edge_count_ -= edges_[id].size();
+			edges_[id].clear();
+			if (stops_[id] == nullptr) {
+				continue;
+			}
+			for (const Bus* bus : guide.FindAllBusesToStop(stops_[id])) {
+				for (uint32_t segment_id : bus->segments) {
+					const RouteSegment& segment = guide.GetSegment(segment_id);
+					if (segment.from == stops_[id] && segment.to != stops_[id]) {
+						edges_[id].push_back({ static_cast<VertexId>(segment.to->id), static_cast<double>(segment.road_distance) });
+					}
+				}
+			}
+			edge_count_ += edges_[id].size();
+		}
+	}
+
+	void RoadGraph::ResetScratch(Scratch& scratch) const {
+		const size_t vertex_count = GetVertexCount();
+		if (scratch.distances_.size() != vertex_count) {
+			scratch.distances_.assign(vertex_count, INFINITE_DISTANCE);
+			scratch.is_target_.assign(vertex_count, false);
+			scratch.settled_.Resize(vertex_count);
+			scratch.touched_.clear();
+		}
+		for (VertexId vertex : scratch.touched_) {
+			scratch.distances_[vertex] = INFINITE_DISTANCE;
+			scratch.settled_.Reset(vertex);
+		}
+		scratch.touched_.clear();
+		scratch.heap_.clear();
+	}
+
+	std::vector<std::optional<double>> RoadGraph::FindDistances(const Stop* from, const std::vector<const Stop*>& to, Scratch& scratch) const {
+		std::vector<std::optional<double>> result(to.size());
+		if (from->id >= GetVertexCount()) {
+			return result;
+		}
+		ResetScratch(scratch);
+
+		//Dijkstra stops as soon as all targets are settled
+		size_t targets_left = 0;
+		for (const Stop* stop : to) {
+			if (stop->id < GetVertexCount() && !scratch.is_target_[stop->id]) {
+				scratch.is_target_[stop->id] = true;
+				++targets_left;
+			}
+		}
+		auto& heap = scratch.heap_;
+		const auto is_later = std::greater<std::pair<double, VertexId>>();
+		const VertexId source = static_cast<VertexId>(from->id);
+		scratch.distances_[source] = 0;
+		scratch.touched_.push_back(source);
+		heap.push_back({ 0, source });
+		while (!heap.empty() && targets_left > 0) {
+			std::pop_heap(heap.begin(), heap.end(), is_later);
+			const auto [distance, vertex] = heap.back();
+			heap.pop_back();
+			if (distance > scratch.distances_[vertex]) {
+				continue;
+			}
+			if (scratch.is_target_[vertex]) {
+				scratch.is_target_[vertex] = false;
+				--targets_left;
+			}
+			for (const Edge& edge : edges_[vertex]) {
+				const double new_distance = distance + edge.weight;
+				if (new_distance < scratch.distances_[edge.to]) {
+					if (scratch.distances_[edge.to] == INFINITE_DISTANCE) {
+						scratch.touched_.push_back(edge.to);
+					}
+					scratch.distances_[edge.to] = new_distance;
+					heap.push_back({ new_distance, edge.to });
+					std::push_heap(heap.begin(), heap.end(), is_later);
+				}
+			}
+		}
+
+		for (size_t i = 0; i < to.size(); ++i) {
+			if (to[i]->id >= GetVertexCount()) {
+				continue;
+			}
+			//targets that were not reached keep their marks till this point
+			scratch.is_target_[to[i]->id] = false;
+			if (scratch.distances_[to[i]->id] != INFINITE_DISTANCE) {
+				result[i] = scratch.distances_[to[i]->id];
+			}
+		}
+		return result;
+	}
+
+	std::vector<std::vector<std::optional<double>>> RoadGraph::FindDistanceMatrix(const std::vector<const Stop*>& from,
+		const std::vector<const Stop*>& to) const {
+		std::vector<std::vector<std::optional<double>>> result(from.size());
+		parallel::ForEachChunk(from.size(), MIN_SOURCES_PER_THREAD,
+			[this, &from, &to, &result](size_t, size_t begin, size_t end) {
+				Scratch scratch;
+				for (size_t i = begin; i < end; ++i) {
+					result[i] = FindDistances(from[i], to, scratch);
+				}
+			});
+		return result;
+	}
+
+	std::vector<ReachedStop> RoadGraph::FindReachable(const std::vector<const Stop*>& from, double max_distance) const {
+		return FindReachable(from, max_distance, scratch_);
+	}
+
+	std::vector<ReachedStop> RoadGraph::FindReachable(const std::vector<const Stop*>& from, double max_distance, Scratch& scratch) const {
+		ResetScratch(scratch);
+		auto& heap = scratch.heap_;
+		const auto is_later = std::greater<std::pair<double, VertexId>>();
+		for (const Stop* stop : from) {
+			const VertexId source = static_cast<VertexId>(stop->id);
+			if (source >= GetVertexCount() || scratch.distances_[source] == 0) {
+				continue;
+			}
+			scratch.distances_[source] = 0;
+			scratch.touched_.push_back(source);
+			heap.push_back({ 0, source });
+		}
+
+		//Dijkstra stops at the first vertex over the budget, the rest are further
+		std::vector<ReachedStop> result;
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), is_later);
+			const auto [distance, vertex] = heap.back();
+			heap.pop_back();
+			if (distance > max_distance) {
+				break;
+			}
+			if (scratch.settled_.Test(vertex)) {
+				continue;
+			}
+			scratch.settled_.Set(vertex);
+			result.push_back({ stops_[vertex], distance });
+			for (const Edge& edge : edges_[vertex]) {
+				const double new_distance = distance + edge.weight;
+				if (new_distance < scratch.distances_[edge.to] && new_distance <= max_distance) {
+					if (scratch.distances_[edge.to] == INFINITE_DISTANCE) {
+						scratch.touched_.push_back(edge.to);
+					}
+					scratch.distances_[edge.to] = new_distance;
+					heap.push_back({ new_distance, edge.to });
+					std::push_heap(heap.begin(), heap.end(), is_later);
+				}
+			}
+		}
+
+		//stops at equal distances are ordered by name
+		std::sort(result.begin(), result.end(), [](const ReachedStop& lhs, const ReachedStop& rhs) {
+			return lhs.cost < rhs.cost || (lhs.cost == rhs.cost && lhs.stop->name < rhs.stop->name);
+		});
+		return result;
+	}
+
+	size_t RoadGraph::GetVertexCount() const {
+		return edges_.size();
+	}
+
+	size_t RoadGraph::GetEdgeCount() const {
+		return edge_count_;
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "dense_bitset.h"
+#include "domain.h"
+#include "transport_catalogue.h"
+
+namespace tg {
+
+	/*Directed graph of stops, edges go between neighbour stops of routes and
+	weigh real road distances. Stop ids index vertices, edges are kept per
+	vertex, so edges of stops touched by changes are collected again from the
+	routes going through them and the rest of the graph stays*/
+	class RoadGraph {
+	public:
+		using VertexId = uint32_t;
+
+		struct Edge {
+			VertexId to = 0;
+			//meters
+			double weight = 0;
+		};
+
+		//Buffers of searches, reused by the searches of one thread
+		class Scratch {
+		private:
+			friend class RoadGraph;
+			std::vector<double> distances_;
+			//vertices with set distance, only they are cleared by the next search
+			std::vector<VertexId> touched_;
+			std::vector<std::pair<double, VertexId>> heap_;
+			std::vector<bool> is_target_;
+			DenseBitset settled_;
+		};
+
+		explicit RoadGraph(const TransportGuide& guide);
+
+		//Edges from stops of changed routes and from changed stops are collected again
+		void Update(const TransportGuide& guide, const CatalogueChanges& changes);
+
+		//Road distances from the stop to every target, nullopt for unreachable ones
+		std::vector<std::optional<double>> FindDistances(const Stop* from, const std::vector<const Stop*>& to, Scratch& scratch) const;
+		//Row for every source, sources are split between threads
+		std::vector<std::vector<std::optional<double>>> FindDistanceMatrix(const std::vector<const Stop*>& from,
+			const std::vector<const Stop*>& to) const;
+		//Stops not further than max_distance meters from any of the sources, sorted by distance and name.
+		//Uses internal scratch
+		std::vector<ReachedStop> FindReachable(const std::vector<const Stop*>& from, double max_distance) const;
+		std::vector<ReachedStop> FindReachable(const std::vector<const Stop*>& from, double max_distance, Scratch& scratch) const;
+
+		size_t GetVertexCount() const;
+		size_t GetEdgeCount() const;
+
+	private:
+		void ResetScratch(Scratch& scratch) const;
+		void AddVertex(const Stop* stop);
+
+		//by source vertex
+		std::vector<std::vector<Edge>> edges_;
+		size_t edge_count_ = 0;
+		//stop of every vertex
+		std::vector<const Stop*> stops_;
+		mutable Scratch scratch_;
+	};
+}
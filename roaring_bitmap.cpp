@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <iterator>
+
+#include "bit_utils.h"
+#include "roaring_bitmap.h"
+
+namespace tg {
+
+	bool RoaringBitmap::Chunk::IsBitmap() const {
+		return !words.empty();
+	}
+
+	bool RoaringBitmap::Chunk::Contains(uint16_t low) const {
+		if (IsBitmap()) {
+			return (words[low / 64] >> (low % 64)) & 1;
+		}
+		return std::binary_search(array.begin(), array.end(), low);
+	}
+
+	void RoaringBitmap::Chunk::Add(uint16_t low) {
+		if (IsBitmap()) {
+			const uint64_t bit = uint64_t{ 1 } << (low % 64);
+			if ((words[low / 64] & bit) == 0) {
+				words[low / 64] |= bit;
+				++cardinality;
+			}
+			return;
+		}
+		//ids usually come in increasing order
+		auto position = array.empty() || array.back() < low ? array.end() : std::lower_bound(array.begin(), array.end(), low);
+		if (position != array.end() && *position == low) {
+			return;
+		}
+		array.insert(position, low);
+		++cardinality;
+		if (array.size() > MAX_ARRAY_SIZE) {
+			ToBitmap();
+		}
+	}
+
+	void RoaringBitmap::Chunk::Remove(uint16_t low) {
+		if (IsBitmap()) {
+			const uint64_t bit = uint64_t{ 1 } << (low % 64);
+			if ((words[low / 64] & bit) != 0) {
+				words[low / 64] &= ~bit;
+				--cardinality;
+				Shrink();
+			}
+			return;
+		}
+		auto position = std::lower_bound(array.begin(), array.end(), low);
+		if (position != array.end() && *position == low) {
+			array.erase(position);
+			--cardinality;
+		}
+	}
+
+	void RoaringBitmap::Chunk::ToBitmap() {
+		words.assign(BITMAP_WORDS, 0);
+		for (uint16_t low : array) {
+			words[low / 64] |= uint64_t{ 1 } << (low % 64);
+		}
+		array.clear();
+		array.shrink_to_fit();
+	}
+
+	void RoaringBitmap::Chunk::Shrink() {
+		if (!IsBitmap() || cardinality > MAX_ARRAY_SIZE) {
+			return;
+		}
+		array.reserve(cardinality);
+		for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+			for (uint64_t word = words[i]; word != 0; word &= word - 1) {
+				array.push_back(static_cast<uint16_t>(i * 64 + bits::CountTrailingZeros(word)));
+			}
+		}
+		words.clear();
+		words.shrink_to_fit();
+	}
+
+	void RoaringBitmap::Add(uint32_t id) {
+		const uint16_t key = static_cast<uint16_t>(id >> 16);
+		auto chunk = std::lower_bound(chunks_.begin(), chunks_.end(), key, [](const Chunk& lhs, uint16_t key) {
+			return lhs.key < key;
+		});
+		if (chunk == chunks_.end() || chunk->key != key) {
+			chunk = chunks_.insert(chunk, Chunk{});
+			chunk->key = key;
+		}
+		chunk->Add(static_cast<uint16_t>(id));
+	}
+
+	void RoaringBitmap::Remove(uint32_t id) {
+		const uint16_t key = static_cast<uint16_t>(id >> 16);
+		auto chunk = std::lower_bound(chunks_.begin(), chunks_.end(), key, [](const Chunk& lhs, uint16_t key) {
+			return lhs.key < key;
+		});
+		if (chunk == chunks_.end() || chunk->key != key) {
+			return;
+		}
+		chunk->Remove(static_cast<uint16_t>(id));
+		//empty chunks are not kept, IsEmpty relies on that
+		if (chunk->cardinality == 0) {
+			chunks_.erase(chunk);
+		}
+	}
+
+	bool RoaringBitmap::Contains(uint32_t id) const {
+		const uint16_t key = static_cast<uint16_t>(id >> 16);
+		auto chunk = std::lower_bound(chunks_.begin(), chunks_.end(), key, [](const Chunk& lhs, uint16_t key) {
+			return lhs.key < key;
+		});
+		return chunk != chunks_.end() && chunk->key == key && chunk->Contains(static_cast<uint16_t>(id));
+	}
+
+	size_t RoaringBitmap::GetCardinality() const {
+		size_t result = 0;
+		for (const Chunk& chunk : chunks_) {
+			result += chunk.cardinality;
+		}
+		return result;
+	}
+
+	bool RoaringBitmap::IsEmpty() const {
+		return chunks_.empty();
+	}
+
+	std::vector<uint32_t> RoaringBitmap::ToVector() const {
+		std::vector<uint32_t> result;
+		result.reserve(GetCardinality());
+		for (const Chunk& chunk : chunks_) {
+			const uint32_t high = uint32_t{ chunk.key } << 16;
+			if (!chunk.IsBitmap()) {
+				for (uint16_t low : chunk.array) {
+					result.push_back(high | low);
+				}
+				continue;
+			}
+			for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+				for (uint64_t word = chunk.words[i]; word != 0; word &= word - 1) {
+					result.push_back(high | static_cast<uint32_t>(i * 64 + bits::CountTrailingZeros(word)));
+				}
+			}
+		}
+		return result;
+	}
+
+	RoaringBitmap::Chunk RoaringBitmap::IntersectChunks(const Chunk& lhs, const Chunk& rhs) {
+		Chunk result;
+		result.key = lhs.key;
+		if (lhs.IsBitmap() && rhs.IsBitmap()) {
+			result.words.resize(BITMAP_WORDS);
+			for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+				result.words[i] = lhs.words[i] & rhs.words[i];
+				result.cardinality += bits::CountOnes(result.words[i]);
+			}
+			result.Shrink();
+			return result;
+		}
+		if (lhs.IsBitmap() || rhs.IsBitmap()) {
+			//the array is probed against the bitmap
+			const Chunk& array = lhs.IsBitmap() ? rhs : lhs;
+			const Chunk& bitmap = lhs.IsBitmap() ? lhs : rhs;
+			for (uint16_t low : array.array) {
+				if (bitmap.Contains(low)) {
+					result.array.push_back(low);
+				}
+			}
+		}
+		else {
+			std::set_intersection(lhs.array.begin(), lhs.array.end(), rhs.array.begin(), rhs.array.end(),
+				std::back_inserter(result.array));
+		}
+		result.cardinality = static_cast<uint32_t>(result.array.size());
+		return result;
+	}
+
+	RoaringBitmap::Chunk RoaringBitmap::UniteChunks(const Chunk& lhs, const Chunk& rhs) {
+		Chunk result;
+		result.key = lhs.key;
+		if (!lhs.IsBitmap() && !rhs.IsBitmap()) {
+			result.array.reserve(lhs.array.size() + rhs.array.size());
+			std::set_union(lhs.array.begin(), lhs.array.end(), rhs.array.begin(), rhs.array.end(),
+				std::back_inserter(result.array));
+			result.cardinality = static_cast<uint32_t>(result.array.size());
+			if (result.array.size() > MAX_ARRAY_SIZE) {
+				result.ToBitmap();
+			}
+			return result;
+		}
+		result.words.assign(BITMAP_WORDS, 0);
+		for (const Chunk* chunk : { &lhs, &rhs }) {
+			if (chunk->IsBitmap()) {
+				for (size_t i = 0; i < BITMAP_WORDS; ++i) {
+					result.words[i] |= chunk->words[i];
+				}
+			}
+			else {
+				for (uint16_t low : chunk->array) {
+					result.words[low / 64] |= uint64_t{ 1 } << (low % 64);
+				}
+			}
+		}
+		for (uint64_t word : result.words) {
+			result.cardinality += bits::CountOnes(word);
+		}
+		return result;
+	}
+
+	RoaringBitmap RoaringBitmap::Intersect(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+		RoaringBitmap result;
+		auto left = lhs.chunks_.begin();
+		auto right = rhs.chunks_.begin();
+		while (left != lhs.chunks_.end() && right != rhs.chunks_.end()) {
+			if (left->key < right->key) {
+				++left;
+			}
+			else if (right->key < left->key) {
+				++right;
+			}
+			else {
+				Chunk chunk = IntersectChunks(*left++, *right++);
+				if (chunk.cardinality != 0) {
+					result.chunks_.push_back(std::move(chunk));
+				}
+			}
+		}
+		return result;
+	}
+
+	RoaringBitmap RoaringBitmap::Unite(const RoaringBitmap& lhs, const RoaringBitmap& rhs) {
+		RoaringBitmap result;
+		auto left = lhs.chunks_.begin();
+		auto right = rhs.chunks_.begin();
+		while (left != lhs.chunks_.end() || right != rhs.chunks_.end()) {
+			if (right == rhs.chunks_.end() || (left != lhs.chunks_.end() && left->key < right->key)) {
+				result.chunks_.push_back(*left++);
+			}
+			else if (left == lhs.chunks_.end() || right->key < left->key) {
+				result.chunks_.push_back(*right++);
+			}
+			else {
+				result.chunks_.push_back(UniteChunks(*left++, *right++));
+			}
+		}
+		return result;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace tg {
+
+	/*Compressed set of 32-bit ids in the roaring layout: ids are split by their
+	upper 16 bits into chunks, a chunk keeps its lower 16 bits either as a sorted
+	array while it is sparse or as a bitmap of 65536 bits once it gets dense.
+	Intersection and union go chunk by chunk and pick the algorithm by the kinds
+	of both chunks*/
+	class RoaringBitmap {
+	public:
+		void Add(uint32_t id);
+		void Remove(uint32_t id);
+		bool Contains(uint32_t id) const;
+		size_t GetCardinality() const;
+		bool IsEmpty() const;
+
+		//Ids in increasing order
+		std::vector<uint32_t> ToVector() const;
+
+		static RoaringBitmap Intersect(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+		static RoaringBitmap Unite(const RoaringBitmap& lhs, const RoaringBitmap& rhs);
+
+	private:
+		//chunks with more ids than that are kept as bitmaps, both forms take 8 KB at this size
+		static const size_t MAX_ARRAY_SIZE = 4096;
+		static const size_t BITMAP_WORDS = 65536 / 64;
+
+		struct Chunk {
+			uint16_t key = 0;
+			//lower bits of ids, sorted, used while words is empty
+			std::vector<uint16_t> array;
+			std::vector<uint64_t> words;
+			uint32_t cardinality = 0;
+
+			bool IsBitmap() const;
+			bool Contains(uint16_t low) const;
+			void Add(uint16_t low);
+			void Remove(uint16_t low);
+			void ToBitmap();
+			//turns a bitmap chunk back into an array if it got sparse
+			void Shrink();
+		};
+
+		static Chunk IntersectChunks(const Chunk& lhs, const Chunk& rhs);
+		static Chunk UniteChunks(const Chunk& lhs, const Chunk& rhs);
+
+		//sorted by key
+		std::vector<Chunk> chunks_;
+	};
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+
+#include "route_index.h"
+
+namespace tg {
+
+	RouteIndex::RouteIndex(const TransportGuide& guide) {
+		//answers order buses as std::string does, not as the catalogue set does
+		buses_.assign(guide.GetSortedBuses().begin(), guide.GetSortedBuses().end());
+		std::sort(buses_.begin(), buses_.end(), BusNameComparator());
+
+		size_t id_bound = 0;
+		for (const Stop* stop : guide.GetSortedStops()) {
+			id_bound = std::max(id_bound, stop->id + 1);
+		}
+		stops_.assign(id_bound, nullptr);
+		for (const Stop* stop : guide.GetSortedStops()) {
+			stops_[stop->id] = stop;
+		}
+
+		stop_buses_.resize(id_bound);
+		bus_stops_.resize(buses_.size());
+		bus_indexes_.reserve(buses_.size());
+		for (uint32_t index = 0; index < buses_.size(); ++index) {
+			AddBus(index, buses_[index]);
+		}
+	}
+
+	void RouteIndex::AddBus(uint32_t index, const Bus* bus) {
+		buses_[index] = bus;
+		bus_indexes_[bus->name] = index;
+		for (const Stop* stop : bus->stops) {
+			AddStop(stop);
+			bus_stops_[index].Add(static_cast<uint32_t>(stop->id));
+			stop_buses_[stop->id].Add(index);
+		}
+	}
+
+	void RouteIndex::AddStop(const Stop* stop) {
+		if (stop->id >= stops_.size()) {
+			stops_.resize(stop->id + 1, nullptr);
+			stop_buses_.resize(stop->id + 1);
+		}
+		stops_[stop->id] = stop;
+	}
+
+	void RouteIndex::Update(const TransportGuide& guide, const CatalogueChanges& changes) {
+		if (!changes.buses.empty()) {
+			is_name_order_ = false;
+		}
+		for (const std::string& name : changes.buses) {
+			if (auto position = bus_indexes_.find(name); position != bus_indexes_.end()) {
+				const uint32_t index = position->second;
+				for (uint32_t id : bus_stops_[index].ToVector()) {
+					stop_buses_[id].Remove(index);
+				}
+				bus_stops_[index] = RoaringBitmap();
+				buses_[index] = nullptr;
+				free_indexes_.push_back(index);
+				bus_indexes_.erase(position);
+			}
+		}
+		//stops are removed only when no bus goes through them
+		for (size_t id : changes.removed_stops) {
+			if (id < stops_.size()) {
+				stops_[id] = nullptr;
+			}
+		}
+		for (const std::string& name : changes.stops) {
+			if (const Stop* stop = guide.FindStop(name)) {
+				AddStop(stop);
+			}
+		}
+		for (const std::string& name : changes.buses) {
+			const Bus* bus = guide.FindBus(name);
+			if (bus == nullptr) {
+				continue;
+			}
+			uint32_t index = static_cast<uint32_t>(buses_.size());
+			if (free_indexes_.empty()) {
+				buses_.push_back(nullptr);
+				bus_stops_.emplace_back();
+			}
+			else {
+				index = free_indexes_.back();
+				free_indexes_.pop_back();
+			}
+			AddBus(index, bus);
+		}
+	}
+
+	RoaringBitmap RouteIndex::UniteStopBuses(const std::vector<const Stop*>& stops) const {
+		RoaringBitmap result;
+		for (const Stop* stop : stops) {
+			if (stop->id < stop_buses_.size()) {
+				result = RoaringBitmap::Unite(result, stop_buses_[stop->id]);
+			}
+		}
+		return result;
+	}
+
+	std::vector<const Bus*> RouteIndex::FindDirectBuses(const std::vector<const Stop*>& from, const std::vector<const Stop*>& to) const {
+		const RoaringBitmap common = RoaringBitmap::Intersect(UniteStopBuses(from), UniteStopBuses(to));
+		std::vector<const Bus*> result;
+		result.reserve(common.GetCardinality());
+		for (uint32_t index : common.ToVector()) {
+			result.push_back(buses_[index]);
+		}
+		if (!is_name_order_) {
+			std::sort(result.begin(), result.end(), BusNameComparator());
+		}
+		return result;
+	}
+
+	std::vector<const Stop*> RouteIndex::FindSharedStops(const std::vector<const Bus*>& buses) const {
+		std::vector<const Stop*> result;
+		if (buses.empty()) {
+			return result;
+		}
+		//the smallest set goes first to keep intermediate sets small
+		std::vector<const RoaringBitmap*> sets;
+		sets.reserve(buses.size());
+		for (const Bus* bus : buses) {
+			sets.push_back(&bus_stops_[bus_indexes_.at(bus->name)]);
+		}
+		std::sort(sets.begin(), sets.end(), [](const RoaringBitmap* lhs, const RoaringBitmap* rhs) {
+			return lhs->GetCardinality() < rhs->GetCardinality();
+		});
+		RoaringBitmap common = *sets.front();
+		for (size_t i = 1; i < sets.size() && !common.IsEmpty(); ++i) {
+			common = RoaringBitmap::Intersect(common, *sets[i]);
+		}
+
+		result.reserve(common.GetCardinality());
+		for (uint32_t id : common.ToVector()) {
+			result.push_back(stops_[id]);
+		}
+		std::sort(result.begin(), result.end(), [](const Stop* lhs, const Stop* rhs) {
+			return lhs->name < rhs->name;
+		});
+		return result;
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "domain.h"
+#include "roaring_bitmap.h"
+#include "transport_catalogue.h"
+
+namespace tg {
+
+	/*Incidence of stops and routes as compressed bitmaps: for every stop the set
+	of indexes of buses going through it and for every bus the set of ids of its
+	stops. Buses are indexed in order of their names when the index is built and
+	keep their indexes, changed buses get free ones, so found buses are sorted
+	by name after the search*/
+	class RouteIndex {
+	public:
+		explicit RouteIndex(const TransportGuide& guide);
+
+		//Bits of changed buses are removed and added again, removed stops are forgotten
+		void Update(const TransportGuide& guide, const CatalogueChanges& changes);
+
+		//Buses going through at least one stop of from and at least one stop of to, sorted by name
+		std::vector<const Bus*> FindDirectBuses(const std::vector<const Stop*>& from, const std::vector<const Stop*>& to) const;
+		//Stops shared by all the buses, sorted by name
+		std::vector<const Stop*> FindSharedStops(const std::vector<const Bus*>& buses) const;
+
+	private:
+		//union of bus sets of the stops
+		RoaringBitmap UniteStopBuses(const std::vector<const Stop*>& stops) const;
+		void AddBus(uint32_t index, const Bus* bus);
+		void AddStop(const Stop* stop);
+
+		//nullptr for free indexes
+		std::vector<const Bus*> buses_;
+		std::vector<uint32_t> free_indexes_;
+		//indexes follow names till buses are changed
+		bool is_name_order_ = true;
+		std::unordered_map<std::string, uint32_t> bus_indexes_;
+		std::vector<RoaringBitmap> bus_stops_;
+		//by stop id
+		std::vector<const Stop*> stops_;
+		std::vector<RoaringBitmap> stop_buses_;
+	};
+}
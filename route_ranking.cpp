@@ -0,0 +1,114 @@
+#include <cmath>
+#include <limits>
+
+#include "route_ranking.h"
+
+namespace tg {
+
+	namespace {
+		//routes with all stops at one point have no curvature, they go last
+		double GetCurvatureKey(const BusStatistics& statistics) {
+			return std::isnan(statistics.curvature) ? -std::numeric_limits<double>::infinity() : statistics.curvature;
+		}
+	}
+
+	bool RouteRanking::ByLength::operator()(const RankedBus& lhs, const RankedBus& rhs) const {
+		if (lhs.statistics.route_length != rhs.statistics.route_length) {
+			return lhs.statistics.route_length > rhs.statistics.route_length;
+		}
+		return lhs.bus->name < rhs.bus->name;
+	}
+
+	bool RouteRanking::ByCurvature::operator()(const RankedBus& lhs, const RankedBus& rhs) const {
+		const double lhs_key = GetCurvatureKey(lhs.statistics);
+		const double rhs_key = GetCurvatureKey(rhs.statistics);
+		if (lhs_key != rhs_key) {
+			return lhs_key > rhs_key;
+		}
+		return lhs.bus->name < rhs.bus->name;
+	}
+
+	bool RouteRanking::ByBusCount::operator()(const RankedStop& lhs, const RankedStop& rhs) const {
+		if (lhs.bus_count != rhs.bus_count) {
+			return lhs.bus_count > rhs.bus_count;
+		}
+		return lhs.stop->name < rhs.stop->name;
+	}
+
+	void RouteRanking::Enable() {
+		is_enabled_ = true;
+	}
+
+	bool RouteRanking::IsEnabled() const {
+		return is_enabled_;
+	}
+
+	void RouteRanking::Invalidate(const Bus* bus) {
+		if (is_enabled_) {
+			changed_.insert(bus);
+		}
+	}
+
+	void RouteRanking::Erase(const Bus* bus) {
+		EraseFromViews(bus);
+		changed_.erase(bus);
+	}
+
+	void RouteRanking::EraseFromViews(const Bus* bus) {
+		auto statistics = statistics_.find(bus);
+		if (statistics == statistics_.end()) {
+			return;
+		}
+		by_length_.erase({ bus, statistics->second });
+		by_curvature_.erase({ bus, statistics->second });
+		statistics_.erase(statistics);
+	}
+
+	void RouteRanking::UpdateStop(const Stop* stop, size_t old_bus_count, size_t new_bus_count) {
+		if (!is_enabled_) {
+			return;
+		}
+		if (old_bus_count != 0) {
+			by_bus_count_.erase({ stop, old_bus_count });
+		}
+		if (new_bus_count != 0) {
+			by_bus_count_.insert({ stop, new_bus_count });
+		}
+	}
+
+	void RouteRanking::Refresh(const StatisticsCounter& count_statistics) {
+		for (const Bus* bus : changed_) {
+			EraseFromViews(bus);
+			const RankedBus ranked{ bus, count_statistics(bus) };
+			statistics_[bus] = ranked.statistics;
+			by_length_.insert(ranked);
+			by_curvature_.insert(ranked);
+		}
+		changed_.clear();
+	}
+
+	std::vector<RankedBus> RouteRanking::GetLongestBuses(size_t count) const {
+		std::vector<RankedBus> result;
+		for (auto it = by_length_.begin(); it != by_length_.end() && result.size() < count; ++it) {
+			result.push_back(*it);
+		}
+		return result;
+	}
+
+	std::vector<RankedBus> RouteRanking::FindBusesWithCurvatureAbove(double min_curvature, size_t count) const {
+		std::vector<RankedBus> result;
+		for (auto it = by_curvature_.begin(); it != by_curvature_.end() && result.size() < count
+			&& it->statistics.curvature > min_curvature; ++it) {
+			result.push_back(*it);
+		}
+		return result;
+	}
+
+	std::vector<RankedStop> RouteRanking::GetBusiestStops(size_t count) const {
+		std::vector<RankedStop> result;
+		for (auto it = by_bus_count_.begin(); it != by_bus_count_.end() && result.size() < count; ++it) {
+			result.push_back(*it);
+		}
+		return result;
+	}
+}
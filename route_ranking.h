@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "domain.h"
+
+namespace tg {
+
+	struct RankedBus {
+		const Bus* bus = nullptr;
+		BusStatistics statistics;
+	};
+
+	struct RankedStop {
+		const Stop* stop = nullptr;
+		size_t bus_count = 0;
+	};
+
+	/*Buses sorted by route length and by curvature and stops sorted by the
+	number of their buses. Nothing is tracked till the ranking is enabled by
+	the first query, so loading of the catalogue does not pay for it. Then stop
+	counts are updated at once, statistics of changed buses are only marked
+	and counted again by the next query. Ties are ordered by name*/
+	class RouteRanking {
+	public:
+		using StatisticsCounter = std::function<BusStatistics(const Bus*)>;
+
+		//Changes before that are ignored, the owner must add everything it has
+		void Enable();
+		bool IsEnabled() const;
+
+		//Route or distances of the bus were changed
+		void Invalidate(const Bus* bus);
+		//Must be called before the bus is destroyed
+		void Erase(const Bus* bus);
+		void UpdateStop(const Stop* stop, size_t old_bus_count, size_t new_bus_count);
+
+		//Counts statistics of changed buses again
+		void Refresh(const StatisticsCounter& count_statistics);
+
+		//Queries below must follow Refresh
+
+		//Up to count buses with the longest routes, longest first
+		std::vector<RankedBus> GetLongestBuses(size_t count) const;
+		//Buses with curvature greater than min_curvature, the most curved first
+		std::vector<RankedBus> FindBusesWithCurvatureAbove(double min_curvature, size_t count) const;
+		//Up to count stops served by the most buses, stops without buses are not ranked
+		std::vector<RankedStop> GetBusiestStops(size_t count) const;
+
+	private:
+		struct ByLength {
+			bool operator()(const RankedBus& lhs, const RankedBus& rhs) const;
+		};
+		struct ByCurvature {
+			bool operator()(const RankedBus& lhs, const RankedBus& rhs) const;
+		};
+		struct ByBusCount {
+			bool operator()(const RankedStop& lhs, const RankedStop& rhs) const;
+		};
+
+		void EraseFromViews(const Bus* bus);
+
+		std::unordered_map<const Bus*, BusStatistics> statistics_;
+		std::unordered_set<const Bus*> changed_;
+		std::set<RankedBus, ByLength> by_length_;
+		std::set<RankedBus, ByCurvature> by_curvature_;
+		std::set<RankedStop, ByBusCount> by_bus_count_;
+		bool is_enabled_ = false;
+	};
+}
@@ -0,0 +1,424 @@
+#include "spatial_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+namespace tg {
+
+	namespace {
+		//length of one degree of latitude on the sphere used by ComputeDistance
+		const double METERS_PER_DEGREE = 6371000 * 3.1415926535 / 180.;
+		const double MAX_LATITUDE = 89.9;
+
+		//how much shorter a degree of longitude is at the latitude
+		double GetLongitudeScale(double lat) {
+			return std::cos(std::min(std::abs(lat), MAX_LATITUDE) * 3.1415926535 / 180.);
+		}
+
+		//Segments crossing more cells go to the list of long segments
+		const int MAX_SEGMENT_CELLS = 64;
+
+		int GetCell(double degrees, double cell_size) {
+			return static_cast<int>(std::floor(degrees / cell_size));
+		}
+
+		uint64_t GetCellKey(int x, int y) {
+			return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+		}
+
+		CellRange GetCellRange(detail::Coordinates min, detail::Coordinates max, double cell_size) {
+			return { GetCell(min.lng, cell_size), GetCell(max.lng, cell_size),
+				GetCell(min.lat, cell_size), GetCell(max.lat, cell_size) };
+		}
+
+		bool IsInBox(detail::Coordinates point, detail::Coordinates min, detail::Coordinates max) {
+			return point.lat >= min.lat && point.lat <= max.lat
+				&& point.lng >= min.lng && point.lng <= max.lng;
+		}
+
+		//Liang-Barsky clipping of the segment by the box
+		bool IsSegmentInBox(detail::Coordinates from, detail::Coordinates to,
+			detail::Coordinates min, detail::Coordinates max) {
+			double t_begin = 0;
+			double t_end = 1;
+			const double delta_lng = to.lng - from.lng;
+			const double delta_lat = to.lat - from.lat;
+			const double p[4] = { -delta_lng, delta_lng, -delta_lat, delta_lat };
+			const double q[4] = { from.lng - min.lng, max.lng - from.lng, from.lat - min.lat, max.lat - from.lat };
+			for (int i = 0; i < 4; ++i) {
+				if (p[i] == 0) {
+					if (q[i] < 0) {
+						return false;
+					}
+					continue;
+				}
+				const double t = q[i] / p[i];
+				if (p[i] < 0) {
+					t_begin = std::max(t_begin, t);
+				}
+				else {
+					t_end = std::min(t_end, t);
+				}
+				if (t_begin > t_end) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool IsCloser(const StopDistance& lhs, const StopDistance& rhs) {
+			if (lhs.distance != rhs.distance) {
+				return lhs.distance < rhs.distance;
+			}
+			return lhs.stop->name < rhs.stop->name;
+		}
+	}
+
+	double ComputeGeoDistance(detail::Coordinates from, detail::Coordinates to) {
+		if (from.lat == to.lat && from.lng == to.lng) {
+			return 0;
+		}
+		const double distance = detail::ComputeDistance(from, to);
+		//acos of a value a bit greater than one for very close points
+		return std::isnan(distance) ? 0 : distance;
+	}
+
+	StopsIndex::StopsIndex(double cell_size_degrees)
+		: cell_size_(cell_size_degrees) {
+	}
+
+	const std::vector<const Stop*>* StopsIndex::FindCell(int x, int y) const {
+		const auto cell = cells_.find(GetCellKey(x, y));
+		return cell == cells_.end() ? nullptr : &cell->second;
+	}
+
+	void StopsIndex::Insert(const Stop* stop) {
+		const int x = GetCell(stop->coordinates.lng, cell_size_);
+		const int y = GetCell(stop->coordinates.lat, cell_size_);
+		if (cells_.empty()) {
+			bounds_ = { x, x, y, y };
+		}
+		else {
+			bounds_.min_x = std::min(bounds_.min_x, x);
+			bounds_.max_x = std::max(bounds_.max_x, x);
+			bounds_.min_y = std::min(bounds_.min_y, y);
+			bounds_.max_y = std::max(bounds_.max_y, y);
+		}
+		cells_[GetCellKey(x, y)].push_back(stop);
+		++size_;
+	}
+
+	void StopsIndex::Erase(const Stop* stop) {
+		const auto cell = cells_.find(GetCellKey(GetCell(stop->coordinates.lng, cell_size_),
+			GetCell(stop->coordinates.lat, cell_size_)));
+		if (cell == cells_.end()) {
+			return;
+		}
+		auto& stops = cell->second;
+		const auto position = std::find(stops.begin(), stops.end(), stop);
+		if (position == stops.end()) {
+			return;
+		}
+		*position = stops.back();
+		stops.pop_back();
+		--size_;
+		if (!stops.empty()) {
+			return;
+		}
+		cells_.erase(cell);
+		//bounds are shrunk only when a cell on the border is emptied
+		const int x = GetCell(stop->coordinates.lng, cell_size_);
+		const int y = GetCell(stop->coordinates.lat, cell_size_);
+		if (x == bounds_.min_x || x == bounds_.max_x || y == bounds_.min_y || y == bounds_.max_y) {
+			RecomputeBounds();
+		}
+	}
+
+	void StopsIndex::RecomputeBounds() {
+		bool is_first = true;
+		for (const auto& [key, stops] : cells_) {
+			const int x = GetCell(stops.front()->coordinates.lng, cell_size_);
+			const int y = GetCell(stops.front()->coordinates.lat, cell_size_);
+			if (is_first) {
+				bounds_ = { x, x, y, y };
+				is_first = false;
+				continue;
+			}
+			bounds_.min_x = std::min(bounds_.min_x, x);
+			bounds_.max_x = std::max(bounds_.max_x, x);
+			bounds_.min_y = std::min(bounds_.min_y, y);
+			bounds_.max_y = std::max(bounds_.max_y, y);
+		}
+	}
+
+	size_t StopsIndex::GetSize() const {
+		return size_;
+	}
+
+	std::vector<StopDistance> StopsIndex::FindNearest(detail::Coordinates point, size_t count) const {
+		std::vector<StopDistance> result;
+		if (size_ == 0 || count == 0) {
+			return result;
+		}
+
+		//the farthest of found stops is on the top
+		std::priority_queue<StopDistance, std::vector<StopDistance>, decltype(&IsCloser)> nearest(IsCloser);
+		auto check_cell = [&](int x, int y) {
+			const auto cell = FindCell(x, y);
+			if (cell == nullptr) {
+				return;
+			}
+			for (const Stop* stop : *cell) {
+				const StopDistance candidate{ stop, ComputeGeoDistance(point, stop->coordinates) };
+				if (nearest.size() < count) {
+					nearest.push(candidate);
+				}
+				else if (IsCloser(candidate, nearest.top())) {
+					nearest.pop();
+					nearest.push(candidate);
+				}
+			}
+		};
+
+		const int center_x = GetCell(point.lng, cell_size_);
+		const int center_y = GetCell(point.lat, cell_size_);
+		//rings that don't cross the bounds are skipped
+		const int first_ring = std::max({ bounds_.min_x - center_x, center_x - bounds_.max_x,
+			bounds_.min_y - center_y, center_y - bounds_.max_y, 0 });
+		const int last_ring = std::max({ center_x - bounds_.min_x, bounds_.max_x - center_x,
+			center_y - bounds_.min_y, bounds_.max_y - center_y, 0 });
+
+		/*Cells are checked ring by ring around the cell of the point.
+		Every stop of the ring is at least (ring - 1) cells away*/
+		for (int ring = first_ring; ring <= last_ring; ++ring) {
+			//every stop was seen, further rings are empty
+			if (nearest.size() == size_) {
+				break;
+			}
+			if (nearest.size() == count && ring > 1) {
+				const double ring_degrees = (ring - 1) * cell_size_;
+				const double ring_meters = ring_degrees * METERS_PER_DEGREE
+					* GetLongitudeScale(std::abs(point.lat) + ring * cell_size_);
+				if (ring_meters > nearest.top().distance) {
+					break;
+				}
+			}
+
+			if (ring == 0) {
+				check_cell(center_x, center_y);
+				continue;
+			}
+			const int min_x = std::max(center_x - ring, bounds_.min_x);
+			const int max_x = std::min(center_x + ring, bounds_.max_x);
+			const int min_y = std::max(center_y - ring + 1, bounds_.min_y);
+			const int max_y = std::min(center_y + ring - 1, bounds_.max_y);
+			for (int x = min_x; x <= max_x; ++x) {
+				check_cell(x, center_y - ring);
+				check_cell(x, center_y + ring);
+			}
+			for (int y = min_y; y <= max_y; ++y) {
+				check_cell(center_x - ring, y);
+				check_cell(center_x + ring, y);
+			}
+		}
+
+		result.resize(nearest.size());
+		for (size_t i = result.size(); i > 0; --i) {
+			result[i - 1] = nearest.top();
+			nearest.pop();
+		}
+		return result;
+	}
+
+	std::vector<StopDistance> StopsIndex::FindInRadius(detail::Coordinates point, double radius) const {
+		std::vector<StopDistance> result;
+		if (size_ == 0 || radius < 0) {
+			return result;
+		}
+
+		auto check_cell = [&](const std::vector<const Stop*>& stops) {
+			for (const Stop* stop : stops) {
+				const double distance = ComputeGeoDistance(point, stop->coordinates);
+				if (distance <= radius) {
+					result.push_back({ stop, distance });
+				}
+			}
+		};
+
+		const double delta_lat = radius / METERS_PER_DEGREE;
+		const double scale = GetLongitudeScale(std::abs(point.lat) + delta_lat);
+		const double delta_lng = scale > 0 ? delta_lat / scale : 360.;
+
+		CellRange range{
+			std::max(GetCell(point.lng - delta_lng, cell_size_), bounds_.min_x),
+			std::min(GetCell(point.lng + delta_lng, cell_size_), bounds_.max_x),
+			std::max(GetCell(point.lat - delta_lat, cell_size_), bounds_.min_y),
+			std::min(GetCell(point.lat + delta_lat, cell_size_), bounds_.max_y) };
+
+		if (range.min_x <= range.max_x && range.min_y <= range.max_y) {
+			const double cells_in_range = (static_cast<double>(range.max_x) - range.min_x + 1)
+				* (static_cast<double>(range.max_y) - range.min_y + 1);
+			//for a huge radius it is cheaper to check every stop
+			if (cells_in_range > cells_.size()) {
+				for (const auto& [key, stops] : cells_) {
+					check_cell(stops);
+				}
+			}
+			else {
+				for (int x = range.min_x; x <= range.max_x; ++x) {
+					for (int y = range.min_y; y <= range.max_y; ++y) {
+						if (const auto cell = FindCell(x, y)) {
+							check_cell(*cell);
+						}
+					}
+				}
+			}
+		}
+
+		std::sort(result.begin(), result.end(), IsCloser);
+		return result;
+	}
+
+	std::vector<const Stop*> StopsIndex::FindInBox(detail::Coordinates min, detail::Coordinates max) const {
+		std::vector<const Stop*> result;
+		if (size_ == 0) {
+			return result;
+		}
+
+		auto check_cell = [&](const std::vector<const Stop*>& stops) {
+			for (const Stop* stop : stops) {
+				if (IsInBox(stop->coordinates, min, max)) {
+					result.push_back(stop);
+				}
+			}
+		};
+
+		const CellRange box = GetCellRange(min, max, cell_size_);
+		const CellRange range{ std::max(box.min_x, bounds_.min_x), std::min(box.max_x, bounds_.max_x),
+			std::max(box.min_y, bounds_.min_y), std::min(box.max_y, bounds_.max_y) };
+		if (range.min_x > range.max_x || range.min_y > range.max_y) {
+			return result;
+		}
+
+		const double cells_in_range = (static_cast<double>(range.max_x) - range.min_x + 1)
+			* (static_cast<double>(range.max_y) - range.min_y + 1);
+		if (cells_in_range > cells_.size()) {
+			for (const auto& [key, stops] : cells_) {
+				check_cell(stops);
+			}
+			return result;
+		}
+		for (int x = range.min_x; x <= range.max_x; ++x) {
+			for (int y = range.min_y; y <= range.max_y; ++y) {
+				if (const auto cell = FindCell(x, y)) {
+					check_cell(*cell);
+				}
+			}
+		}
+		return result;
+	}
+
+	// ---------- SegmentsIndex ------------------
+
+	SegmentsIndex::SegmentsIndex(double cell_size_degrees)
+		: cell_size_(cell_size_degrees) {
+	}
+
+	template <typename Action>
+	bool SegmentsIndex::ForEachSegmentCell(const Bus* bus, size_t index, Action action) const {
+		const auto& from = bus->stops[index]->coordinates;
+		const auto& to = bus->stops[index + 1]->coordinates;
+		const CellRange range = GetCellRange({ std::min(from.lat, to.lat), std::min(from.lng, to.lng) },
+			{ std::max(from.lat, to.lat), std::max(from.lng, to.lng) }, cell_size_);
+		const double cells = (static_cast<double>(range.max_x) - range.min_x + 1)
+			* (static_cast<double>(range.max_y) - range.min_y + 1);
+		if (cells > MAX_SEGMENT_CELLS) {
+			return false;
+		}
+		for (int x = range.min_x; x <= range.max_x; ++x) {
+			for (int y = range.min_y; y <= range.max_y; ++y) {
+				action(GetCellKey(x, y));
+			}
+		}
+		return true;
+	}
+
+	void SegmentsIndex::Insert(const Bus* bus) {
+		for (size_t i = 0; i + 1 < bus->stops.size(); ++i) {
+			const bool is_short = ForEachSegmentCell(bus, i, [&](uint64_t key) {
+				cells_[key].push_back({ bus, i });
+			});
+			if (!is_short) {
+				long_segments_.push_back({ bus, i });
+			}
+		}
+	}
+
+	void SegmentsIndex::Erase(const Bus* bus) {
+		auto is_bus_segment = [bus](const Segment& segment) {
+			return segment.bus == bus;
+		};
+		bool has_long_segments = false;
+		for (size_t i = 0; i + 1 < bus->stops.size(); ++i) {
+			const bool is_short = ForEachSegmentCell(bus, i, [&](uint64_t key) {
+				const auto cell = cells_.find(key);
+				if (cell == cells_.end()) {
+					return;
+				}
+				auto& segments = cell->second;
+				segments.erase(std::remove_if(segments.begin(), segments.end(), is_bus_segment), segments.end());
+				if (segments.empty()) {
+					cells_.erase(cell);
+				}
+			});
+			has_long_segments = has_long_segments || !is_short;
+		}
+		if (has_long_segments) {
+			long_segments_.erase(std::remove_if(long_segments_.begin(), long_segments_.end(), is_bus_segment),
+				long_segments_.end());
+		}
+	}
+
+	std::unordered_map<const Bus*, std::vector<size_t>> SegmentsIndex::FindInBox(detail::Coordinates min, detail::Coordinates max) const {
+		std::unordered_map<const Bus*, std::vector<size_t>> result;
+		auto check_segment = [&](const Segment& segment) {
+			const auto& from = segment.bus->stops[segment.index]->coordinates;
+			const auto& to = segment.bus->stops[segment.index + 1]->coordinates;
+			if (IsSegmentInBox(from, to, min, max)) {
+				auto& indexes = result[segment.bus];
+				indexes.push_back(segment.index);
+				//segment of the way back of a non-circle route
+				if (!segment.bus->isCircle) {
+					indexes.push_back(segment.bus->GetStopCount() - 2 - segment.index);
+				}
+			}
+		};
+
+		const CellRange range = GetCellRange(min, max, cell_size_);
+		const double cells_in_range = (static_cast<double>(range.max_x) - range.min_x + 1)
+			* (static_cast<double>(range.max_y) - range.min_y + 1);
+		if (cells_in_range > cells_.size()) {
+			for (const auto& [key, segments] : cells_) {
+				std::for_each(segments.begin(), segments.end(), check_segment);
+			}
+		}
+		else {
+			for (int x = range.min_x; x <= range.max_x; ++x) {
+				for (int y = range.min_y; y <= range.max_y; ++y) {
+					if (const auto cell = cells_.find(GetCellKey(x, y)); cell != cells_.end()) {
+						std::for_each(cell->second.begin(), cell->second.end(), check_segment);
+					}
+				}
+			}
+		}
+		std::for_each(long_segments_.begin(), long_segments_.end(), check_segment);
+
+		//segment is found in every cell it crosses
+		for (auto& [bus, segments] : result) {
+			std::sort(segments.begin(), segments.end());
+			segments.erase(std::unique(segments.begin(), segments.end()), segments.end());
+		}
+		return result;
+	}
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "domain.h"
+#include "geo.h"
+
+namespace tg {
+
+	//Cells of the index grid from min to max inclusive
+	struct CellRange {
+		int min_x = 0;
+		int max_x = 0;
+		int min_y = 0;
+		int max_y = 0;
+	};
+
+	struct StopDistance {
+		const Stop* stop = nullptr;
+		//meters
+		double distance = 0;
+	};
+
+	/*Spatial hash over stop coordinates. The plane of latitude and longitude
+	is split into square cells, only cells that are close to the point are
+	checked by queries. Stops can be added and removed one by one*/
+	class StopsIndex {
+	public:
+		explicit StopsIndex(double cell_size_degrees = 0.005);
+
+		void Insert(const Stop* stop);
+		//Must be called before coordinates of the stop are changed
+		void Erase(const Stop* stop);
+
+		//Up to count closest stops sorted by distance
+		std::vector<StopDistance> FindNearest(detail::Coordinates point, size_t count) const;
+		//Stops not further than radius meters sorted by distance
+		std::vector<StopDistance> FindInRadius(detail::Coordinates point, double radius) const;
+
+		//Stops inside the box, min is left bottom corner and max is right top one
+		std::vector<const Stop*> FindInBox(detail::Coordinates min, detail::Coordinates max) const;
+
+		size_t GetSize() const;
+
+	private:
+		const std::vector<const Stop*>* FindCell(int x, int y) const;
+		void RecomputeBounds();
+
+		double cell_size_;
+		std::unordered_map<uint64_t, std::vector<const Stop*>> cells_;
+		//cells that have stops, bounds the search
+		CellRange bounds_;
+		size_t size_ = 0;
+	};
+
+	/*Spatial hash over route segments, segment i of the bus goes from
+	bus->GetStop(i) to bus->GetStop(i + 1). Only stored stops are indexed,
+	segments of the way back of non-circle routes are reported together with
+	the segments they mirror. Segments that cross too many cells are kept in
+	a separate list which is checked by every query*/
+	class SegmentsIndex {
+	public:
+		explicit SegmentsIndex(double cell_size_degrees = 0.005);
+
+		void Insert(const Bus* bus);
+		//Must be called before coordinates of the bus stops are changed
+		void Erase(const Bus* bus);
+
+		//Sorted indexes of segments crossing the box for every bus that crosses it
+		std::unordered_map<const Bus*, std::vector<size_t>> FindInBox(detail::Coordinates min, detail::Coordinates max) const;
+
+	private:
+		struct Segment {
+			const Bus* bus = nullptr;
+			size_t index = 0;
+		};
+
+		//Calls action(cell key) for every cell of the segment box, returns false for long segment
+		template <typename Action>
+		bool ForEachSegmentCell(const Bus* bus, size_t index, Action action) const;
+
+		double cell_size_;
+		std::unordered_map<uint64_t, std::vector<Segment>> cells_;
+		std::vector<Segment> long_segments_;
+	};
+
+	//ComputeDistance that is exact zero for the same point
+	double ComputeGeoDistance(detail::Coordinates from, detail::Coordinates to);
+}
@@ -1,5 +1,7 @@
 #include "svg.h"
+#include "parallel.h"
 
+#include <iterator>
 #include <sstream>
 
 namespace svg {
@@ -14,6 +16,12 @@ namespace svg {
         red(red_), green(green_), blue(blue_), opacity(opacity_)
     {}
 
+    std::string ColorToString(const Color& color) {
+        std::ostringstream out;
+        std::visit(ColorPrintVariants{ out }, color);
+        return out.str();
+    }
+
     // ---------- Overloading SLC & SLJ ------------------
 
     std::ostream& operator<<(std::ostream& stream, const StrokeLineCap& stroke_line_cap) {
@@ -178,12 +186,37 @@ namespace svg {
         objects_.emplace_back(move(obj));
     }
 
+    void Document::Append(Document&& other) {
+        std::move(other.objects_.begin(), other.objects_.end(), std::back_inserter(objects_));
+        other.objects_.clear();
+    }
+
     void Document::Render(std::ostream& out) const {
         out << "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>"s << std::endl;
         out << "<svg xmlns=\"http://www.w3.org/2000/svg\" version=\"1.1\">"s << std::endl;
-        RenderContext ctx(out, 2, 2);
-        for (const auto& obj : objects_) {
-            obj->Render(ctx);
+        const size_t min_objects_per_thread = 2048;
+        const size_t chunks = parallel::GetChunkCount(objects_.size(), min_objects_per_thread);
+        if (chunks <= 1) {
+            RenderContext ctx(out, 2, 2);
+            for (const auto& obj : objects_) {
+                obj->Render(ctx);
+            }
+        }
+        else {
+            //every chunk is printed with the format of out, so the text is the same
+            std::vector<std::ostringstream> parts(chunks);
+            for (auto& part : parts) {
+                part.copyfmt(out);
+            }
+            parallel::ForEachChunk(objects_.size(), min_objects_per_thread, [&](size_t chunk, size_t begin, size_t end) {
+                RenderContext ctx(parts[chunk], 2, 2);
+                for (size_t i = begin; i < end; ++i) {
+                    objects_[i]->Render(ctx);
+                }
+            });
+            for (const auto& part : parts) {
+                out << part.str();
+            }
         }
         out << "</svg>"sv;
     }
@@ -78,6 +78,9 @@ namespace svg {
     using Color = std::variant<std::monostate, std::string, svg::Rgb, svg::Rgba>;
     inline const Color NoneColor{ "none" };
 
+    //Color as it is printed in attributes
+    std::string ColorToString(const Color& color);
+
     template <typename Owner>
     class PathProps {
     public:
@@ -283,6 +286,9 @@ namespace svg {
     class Document final : public ObjectContainer {
     public:
         void AddPtr(std::shared_ptr<Object>&& obj) override;
+        //Moves objects of the other document to the end of this one
+        void Append(Document&& other);
+        //Large documents are rendered in chunks on several threads
         void Render(std::ostream& out) const;
     };
 
@@ -0,0 +1,55 @@
+#!/bin/sh
+# Regression inputs: tests/<name>.json is fed to the program given as the
+# first argument and the answers must match tests/<name>.expected.json.
+# route_hierarchy.json runs twice in an empty directory: the first run builds
+# and saves the contraction hierarchy, the second answers with the loaded one.
+# parallel_render.json runs on one and on four threads, both answers must match
+# the same expected output.
+# trace.json runs on one thread with --trace and the written trace is compared
+# instead of the answers.
+# Answers of inputs with tests/<name>.sed are passed through it first, so
+# measured times can be replaced by constants.
+
+program=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+tests=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+check() {
+    if [ -f "$tests/$1.sed" ]; then
+        sed -f "$tests/$1.sed" "$work/$2" > "$work/$2.sed" && mv "$work/$2.sed" "$work/$2"
+    fi
+    if cmp -s "$tests/$1.expected.json" "$work/$2"; then
+        echo "ok   $2"
+    else
+        echo "FAIL $2"
+        diff "$tests/$1.expected.json" "$work/$2" | head -20
+        failed=1
+    fi
+}
+
+for input in "$tests"/*.json; do
+    case "$input" in *.expected.json) continue ;; esac
+    name=$(basename "$input" .json)
+    if [ "$name" = route_hierarchy ]; then
+        (cd "$work" && "$program" < "$input" > "$name.build.out" 2> "$name.err" \
+            && "$program" < "$input" > "$name.loaded.out" 2> "$name.err")
+        [ -f "$work/route_hierarchy.ch" ] || { echo "FAIL $name: hierarchy file is not saved"; failed=1; }
+        check "$name" "$name.build.out"
+        check "$name" "$name.loaded.out"
+    elif [ "$name" = trace ]; then
+        (cd "$work" && "$program" --threads=1 --trace="$name.events" < "$input" > "$name.out" 2> "$name.err")
+        check "$name" "$name.events"
+    elif [ "$name" = parallel_render ]; then
+        for threads in 1 4; do
+            (cd "$work" && "$program" --threads=$threads < "$input" > "$name.$threads.out" 2> "$name.err")
+            check "$name" "$name.$threads.out"
+        done
+    else
+        #inputs with a broken document stop the program, answers before it are still compared
+        (cd "$work" && "$program" < "$input" > "$name.out" 2> "$name.err")
+        check "$name" "$name.out"
+    fi
+done
+exit $failed
@@ -0,0 +1,162 @@
+#include "trace.h"
+
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+
+namespace trace {
+
+    namespace {
+        struct Event {
+            std::string name;
+            std::string category;
+            std::vector<std::pair<std::string, std::string>> args;
+            double start_us = 0;
+            double duration_us = 0;
+            int thread_id = 0;
+        };
+
+        struct Tracer {
+            std::atomic<bool> enabled{ false };
+            std::mutex mutex;
+            std::string path;
+            std::vector<Event> events;
+            std::chrono::steady_clock::time_point origin;
+        };
+
+        Tracer& GetTracer() {
+            static Tracer tracer;
+            return tracer;
+        }
+
+        //Small sequential numbers are easier to read than std::thread::id
+        int GetThreadId() {
+            static std::atomic<int> next_id{ 1 };
+            thread_local const int id = next_id.fetch_add(1);
+            return id;
+        }
+
+        double ToMicroseconds(std::chrono::steady_clock::duration duration) {
+            return std::chrono::duration<double, std::micro>(duration).count();
+        }
+
+        void PrintString(std::ostream& out, const std::string& str) {
+            out << '"';
+            for (const char symbol : str) {
+                switch (symbol) {
+                case '"':
+                    out << "\\\"";
+                    break;
+                case '\\':
+                    out << "\\\\";
+                    break;
+                case '\n':
+                    out << "\\n";
+                    break;
+                case '\t':
+                    out << "\\t";
+                    break;
+                default:
+                    if (static_cast<unsigned char>(symbol) < 0x20) {
+                        out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+                            << static_cast<int>(symbol) << std::dec << std::setfill(' ');
+                    }
+                    else {
+                        out << symbol;
+                    }
+                    break;
+                }
+            }
+            out << '"';
+        }
+
+        void PrintEvent(std::ostream& out, const Event& event) {
+            out << "{\"name\": ";
+            PrintString(out, event.name);
+            out << ", \"cat\": ";
+            PrintString(out, event.category);
+            out << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread_id
+                << ", \"ts\": " << event.start_us << ", \"dur\": " << event.duration_us;
+            if (!event.args.empty()) {
+                out << ", \"args\": {";
+                bool is_first = true;
+                for (const auto& [key, value] : event.args) {
+                    if (!is_first) {
+                        out << ", ";
+                    }
+                    PrintString(out, key);
+                    out << ": ";
+                    PrintString(out, value);
+                    is_first = false;
+                }
+                out << '}';
+            }
+            out << '}';
+        }
+    }
+
+    void Start(const std::string& path) {
+        auto& tracer = GetTracer();
+        std::lock_guard guard(tracer.mutex);
+        tracer.path = path;
+        tracer.events.clear();
+        tracer.origin = std::chrono::steady_clock::now();
+        tracer.enabled = true;
+    }
+
+    void Finish() {
+        auto& tracer = GetTracer();
+        std::lock_guard guard(tracer.mutex);
+        if (!tracer.enabled) {
+            return;
+        }
+        tracer.enabled = false;
+
+        std::ofstream out(tracer.path);
+        out << std::fixed << std::setprecision(3);
+        out << "{\"traceEvents\": [\n";
+        for (size_t i = 0; i < tracer.events.size(); ++i) {
+            PrintEvent(out, tracer.events[i]);
+            out << (i + 1 != tracer.events.size() ? ",\n" : "\n");
+        }
+        out << "], \"displayTimeUnit\": \"ms\"}\n";
+        tracer.events.clear();
+    }
+
+    bool IsEnabled() {
+        return GetTracer().enabled.load(std::memory_order_relaxed);
+    }
+
+    // ---------- Span ------------------
+
+    Span::Span(std::string_view name, std::string_view category)
+        : enabled_(IsEnabled()) {
+        if (enabled_) {
+            name_ = name;
+            category_ = category;
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    Span::~Span() {
+        if (!enabled_) {
+            return;
+        }
+        const auto finish = std::chrono::steady_clock::now();
+        auto& tracer = GetTracer();
+        std::lock_guard guard(tracer.mutex);
+        if (!tracer.enabled) {
+            return;
+        }
+        tracer.events.push_back({ std::move(name_), std::move(category_), std::move(args_),
+            ToMicroseconds(start_ - tracer.origin), ToMicroseconds(finish - start_), GetThreadId() });
+    }
+
+    Span& Span::AddArg(std::string_view key, std::string_view value) {
+        if (enabled_) {
+            args_.emplace_back(key, value);
+        }
+        return *this;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*Chrome trace-event profiling, the result can be opened
+in chrome://tracing or https://ui.perfetto.dev*/
+namespace trace {
+
+    //Starts to collect spans, they are written to the file by Finish
+    void Start(const std::string& path);
+
+    //Writes collected spans and stops tracing
+    void Finish();
+
+    bool IsEnabled();
+
+    //Measures the scope as one complete ("X") event. Does nothing if tracing is off
+    class Span {
+    public:
+        Span(std::string_view name, std::string_view category);
+        ~Span();
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        //Adds argument shown in the event details
+        Span& AddArg(std::string_view key, std::string_view value);
+
+    private:
+        bool enabled_ = false;
+        std::string name_;
+        std::string category_;
+        std::vector<std::pair<std::string, std::string>> args_;
+        std::chrono::steady_clock::time_point start_;
+    };
+}
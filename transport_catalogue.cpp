@@ -1,23 +1,64 @@
 #include <unordered_set>
 #include <vector>
+#include <iterator>
 #include <optional>
 #include <stdexcept>
 
 #include "transport_catalogue.h"
+#include "memory_stats.h"
 
 namespace tg {
 
 	//add stop
 	void TransportGuide::AddStop(std::string name, Coordinates coordinates) {
+		memory::Scope memory_scope(memory::Subsystem::CATALOGUE);
 		if (name_to_stop_.count(name) != 0) {
-			name_to_stop_.at(name)->coordinates = std::move(coordinates);
+			Stop& stop = *name_to_stop_.at(name);
+			const StopBuses& buses = FindAllBusesToStop(&stop);
+			if (stops_without_coordinates_.erase(&stop) == 0) {
+				stops_index_.Erase(&stop);
+			}
+			for (const Bus* bus : buses) {
+				segments_index_.Erase(bus);
+			}
+			stop.coordinates = std::move(coordinates);
+			stops_index_.Insert(&stop);
+			for (const Bus* bus : buses) {
+				for (uint32_t id : bus->segments) {
+					RouteSegment& segment = segments_[id];
+					if (segment.from == &stop || segment.to == &stop) {
+						segment.geo_length = ComputeDistance(segment.from->coordinates, segment.to->coordinates);
+					}
+				}
+				segments_index_.Insert(bus);
+				route_ranking_.Invalidate(bus);
+			}
 		}
 		else
 		{
-			stops_.push_back({ name, coordinates });
-			name_to_stop_[name] = &stops_.back();
-			stops_ptr_set_.insert(std::make_shared<Stop>(stops_.back()));
+			stops_.push_back({ name, coordinates, next_stop_id_++ });
+			name_to_stop_[name] = std::prev(stops_.end());
+			sorted_stops_.insert(&stops_.back());
+			stops_index_.Insert(&stops_.back());
 		}
+		RecordStopChange(&*name_to_stop_.at(name));
+		++version_;
+	}
+
+	//not indexed, otherwise the spatial index would stretch from the city to (0, 0)
+	void TransportGuide::AddStopWithoutCoordinates(std::string name) {
+		memory::Scope memory_scope(memory::Subsystem::CATALOGUE);
+		stops_.push_back({ name, { 0, 0 }, next_stop_id_++ });
+		name_to_stop_[name] = std::prev(stops_.end());
+		sorted_stops_.insert(&stops_.back());
+		stops_without_coordinates_.insert(&stops_.back());
+		RecordStopChange(&stops_.back());
+		++version_;
+	}
+
+	void TransportGuide::ReserveStops(size_t count) {
+		name_to_stop_.reserve(count);
+		stop_to_routes_.reserve(count);
 	}
 
 	//add bus
@@ -30,31 +71,125 @@ namespace tg {
 				//Перед тем как добавить автобус
 				//Нужно чтобы были добавлены все остановки, даже те
 				//координаты которых мы не знаем
-				AddStop(stop, { 0,0 });
+				AddStopWithoutCoordinates(stop);
 			}
-			const Stop* stopPtr = name_to_stop_.at(stop);
+			const Stop* stopPtr = &*name_to_stop_.at(stop);
 			stops.push_back(stopPtr);
 		}
 
-		if (!isCircle && stop_names.size() > 0) {
-			for (int i = stops.size() - 2; i >= 0; --i) {
-				stops.push_back(stops[i]);
+		AddBus(std::move(name), std::move(stops), isCircle);
+	}
+
+	void TransportGuide::AddBus(std::string name, std::vector<const Stop*> stops, bool isCircle) {
+		memory::Scope memory_scope(memory::Subsystem::CATALOGUE);
+		RemoveBus(name);
+
+		const int unique_stops = std::unordered_set<const Stop*>(stops.begin(), stops.end()).size();
+		buses_.push_back({ name, std::move(stops), isCircle, unique_stops, {} });
+		Bus& bus = buses_.back();
+		const size_t stop_count = bus.GetStopCount();
+		bus.segments.reserve(stop_count > 0 ? stop_count - 1 : 0);
+		for (size_t i = 1; i < stop_count; ++i) {
+			bus.segments.push_back(AcquireSegment(bus.GetStop(i - 1), bus.GetStop(i)));
+		}
+		this->name_to_route_.insert({ std::move(name), std::prev(buses_.end()) });
+		sorted_buses_.insert(&buses_.back());
+		segments_index_.Insert(&buses_.back());
+
+		for (auto stop_pointer : buses_.back().stops) {
+			auto& routes = stop_to_routes_[stop_pointer];
+			if (routes.insert(&buses_.back()).second) {
+				route_ranking_.UpdateStop(stop_pointer, routes.size() - 1, routes.size());
 			}
 		}
+		route_ranking_.Invalidate(&buses_.back());
+		if (changes_ != nullptr) {
+			changes_->buses.insert(buses_.back().name);
+		}
+		++version_;
+	}
 
-		buses_.push_back({ name, stops, isCircle });
-		this->name_to_route_.insert({ name, &buses_.back() });
-		buses_ptr_set_.insert(std::make_shared<Bus>(buses_.back()));
+	//remove bus
+	bool TransportGuide::RemoveBus(const std::string& name) {
+		auto search_for_bus = name_to_route_.find(name);
+		if (search_for_bus == name_to_route_.end()) {
+			return false;
+		}
 
-		for (auto stop_pointer : stops) {
-			stop_to_routes_[stop_pointer].insert(&buses_.back());
+		Bus* bus = &*search_for_bus->second;
+		if (changes_ != nullptr) {
+			changes_->buses.insert(name);
+			changes_->old_buses.insert(bus);
+			for (const Stop* stop : bus->stops) {
+				changes_->old_route_stops.insert(stop->id);
+			}
+		}
+		for (const Stop* stop : bus->stops) {
+			auto routes = stop_to_routes_.find(stop);
+			if (routes == stop_to_routes_.end()) {
+				continue;
+			}
+			if (routes->second.erase(bus) != 0) {
+				route_ranking_.UpdateStop(stop, routes->second.size() + 1, routes->second.size());
+			}
+			if (routes->second.empty()) {
+				stop_to_routes_.erase(routes);
+			}
 		}
+
+		for (uint32_t id : bus->segments) {
+			ReleaseSegment(id);
+		}
+		segments_index_.Erase(bus);
+		route_ranking_.Erase(bus);
+		sorted_buses_.erase(bus);
+		buses_.erase(search_for_bus->second);
+		name_to_route_.erase(search_for_bus);
+		++version_;
+		return true;
+	}
+
+	//remove stop
+	bool TransportGuide::RemoveStop(const std::string& name) {
+		auto search_for_stop = name_to_stop_.find(name);
+		if (search_for_stop == name_to_stop_.end()) {
+			return false;
+		}
+
+		const Stop* stop = &*search_for_stop->second;
+		if (stop_to_routes_.count(stop) != 0) {
+			return false;
+		}
+
+		if (auto neighbours = distance_neighbours_.find(stop); neighbours != distance_neighbours_.end()) {
+			for (const Stop* other : neighbours->second) {
+				stops_distance.erase({ stop, other });
+				stops_distance.erase({ other, stop });
+				if (other != stop) {
+					distance_neighbours_.at(other).erase(stop);
+				}
+			}
+			distance_neighbours_.erase(neighbours);
+		}
+
+		RecordStopChange(stop);
+		if (changes_ != nullptr) {
+			changes_->removed_stops.insert(stop->id);
+		}
+		sorted_stops_.erase(stop);
+		if (stops_without_coordinates_.erase(stop) == 0) {
+			stops_index_.Erase(stop);
+		}
+		stops_.erase(search_for_stop->second);
+		name_to_stop_.erase(search_for_stop);
+		++version_;
+		return true;
 	}
 
 	//find bus by name
-	const Bus* TransportGuide::FindBus(std::string name) const {
+	const Bus* TransportGuide::FindBus(const std::string& name) const {
 		if (name_to_route_.find(name) != name_to_route_.end()) {
-			return name_to_route_.at(name);
+			return &*name_to_route_.at(name);
 		}
 		else {
 			return nullptr;
@@ -62,9 +197,9 @@ namespace tg {
 	}
 
 	//find stop by name
-	const Stop* TransportGuide::FindStop(std::string name) const {
+	const Stop* TransportGuide::FindStop(const std::string& name) const {
 		if (name_to_stop_.find(name) != name_to_stop_.end()) {
-			return name_to_stop_.at(name);
+			return &*name_to_stop_.at(name);
 		}
 		else {
 			return nullptr;
@@ -72,21 +207,22 @@ namespace tg {
 	}
 
 	//find all buses that have given stop in route
-	const std::unordered_set<Bus*> TransportGuide::FindAllBusesToStop(const Stop* stop) {
-		if (stop_to_routes_.find(stop) != stop_to_routes_.end()) {
-			return stop_to_routes_.at(stop);
+	const StopBuses& TransportGuide::FindAllBusesToStop(const Stop* stop) const {
+		static const StopBuses no_buses;
+		if (auto routes = stop_to_routes_.find(stop); routes != stop_to_routes_.end()) {
+			return routes->second;
 		}
 		else
 		{
-			return std::unordered_set<Bus*>();
+			return no_buses;
 		}
 	}
 
-	bool TransportGuide::IsStopDontHaveBuses(const std::shared_ptr<Stop> stop) {
-		auto search_for_stop = name_to_stop_.find(stop.get()->name);
+	bool TransportGuide::IsStopDontHaveBuses(const Stop* stop) const {
+		auto search_for_stop = name_to_stop_.find(stop->name);
 
 		if (search_for_stop != name_to_stop_.end()) {
-			if (stop_to_routes_.find(search_for_stop->second) != stop_to_routes_.end()) {
+			if (stop_to_routes_.find(&*search_for_stop->second) != stop_to_routes_.end()) {
 				return true;
 			}
 			else {
@@ -97,6 +233,22 @@ namespace tg {
 	}
 
 
+	std::vector<StopDistance> TransportGuide::FindNearestStops(Coordinates point, size_t count) const {
+		return stops_index_.FindNearest(point, count);
+	}
+
+	std::vector<StopDistance> TransportGuide::FindStopsInRadius(Coordinates point, double radius) const {
+		return stops_index_.FindInRadius(point, radius);
+	}
+
+	std::vector<const Stop*> TransportGuide::FindStopsInBox(Coordinates min, Coordinates max) const {
+		return stops_index_.FindInBox(min, max);
+	}
+
+	std::unordered_map<const Bus*, std::vector<size_t>> TransportGuide::FindRouteSegmentsInBox(Coordinates min, Coordinates max) const {
+		return segments_index_.FindInBox(min, max);
+	}
+
 	int TransportGuide::GetRealStopsDistance(const Stop* stop_A, const Stop* stop_B) const {
 		std::pair<const Stop*, const Stop*> pairAB{ stop_A, stop_B };
 		if (stops_distance.count(pairAB) > 0) {
@@ -114,17 +266,145 @@ namespace tg {
 		return 0;
 	}
 
+	BusStatistics TransportGuide::ComputeBusStatistics(const Bus* bus) const {
+		double coords_length = 0;
+		double length = 0;
+
+		for (uint32_t id : bus->segments) {
+			const RouteSegment& segment = segments_[id];
+			coords_length += segment.geo_length;
+			length += segment.road_distance;
+		}
+
+		return BusStatistics{ static_cast<int>(bus->GetStopCount()), bus->unique_stops, (int)length, length / coords_length };
+	}
+
+	void TransportGuide::RefreshRanking() const {
+		if (!route_ranking_.IsEnabled()) {
+			route_ranking_.Enable();
+			for (const Bus& bus : buses_) {
+				route_ranking_.Invalidate(&bus);
+			}
+			for (const auto& [stop, routes] : stop_to_routes_) {
+				route_ranking_.UpdateStop(stop, 0, routes.size());
+			}
+		}
+		route_ranking_.Refresh([this](const Bus* bus) { return ComputeBusStatistics(bus); });
+	}
+
+	std::vector<RankedBus> TransportGuide::GetLongestBuses(size_t count) const {
+		RefreshRanking();
+		return route_ranking_.GetLongestBuses(count);
+	}
+
+	std::vector<RankedBus> TransportGuide::FindBusesWithCurvatureAbove(double min_curvature, size_t count) const {
+		RefreshRanking();
+		return route_ranking_.FindBusesWithCurvatureAbove(min_curvature, count);
+	}
+
+	std::vector<RankedStop> TransportGuide::GetBusiestStops(size_t count) const {
+		RefreshRanking();
+		return route_ranking_.GetBusiestStops(count);
+	}
+
+	const RouteSegment& TransportGuide::GetSegment(uint32_t id) const {
+		return segments_[id];
+	}
+
+	uint32_t TransportGuide::AcquireSegment(const Stop* from, const Stop* to) {
+		auto [position, is_new] = segment_ids_.emplace(std::pair<const Stop*, const Stop*>{ from, to }, 0);
+		if (is_new) {
+			const RouteSegment segment{ from, to, ComputeDistance(from->coordinates, to->coordinates), GetRealStopsDistance(from, to) };
+			if (free_segments_.empty()) {
+				position->second = static_cast<uint32_t>(segments_.size());
+				segments_.push_back(segment);
+				segment_references_.push_back(0);
+			}
+			else {
+				position->second = free_segments_.back();
+				free_segments_.pop_back();
+				segments_[position->second] = segment;
+			}
+		}
+		++segment_references_[position->second];
+		return position->second;
+	}
+
+	void TransportGuide::ReleaseSegment(uint32_t id) {
+		if (--segment_references_[id] == 0) {
+			segment_ids_.erase({ segments_[id].from, segments_[id].to });
+			free_segments_.push_back(id);
+		}
+	}
+
+	void TransportGuide::UpdateSegmentDistances(const Stop* stopA, const Stop* stopB) {
+		for (const auto& key : { std::pair<const Stop*, const Stop*>{ stopA, stopB }, std::pair<const Stop*, const Stop*>{ stopB, stopA } }) {
+			if (const auto id = segment_ids_.find(key); id != segment_ids_.end()) {
+				segments_[id->second].road_distance = GetRealStopsDistance(key.first, key.second);
+			}
+		}
+	}
+
 	//Add stop distance between A and B
 	void TransportGuide::SetStopsDistance(const std::string stop_name_A, const std::string stop_name_B, int distance) {
+		SetStopsDistance(FindStop(stop_name_A), FindStop(stop_name_B), distance);
+	}
+
+	void TransportGuide::SetStopsDistance(const Stop* stopA, const Stop* stopB, int distance) {
+		if (stopA == nullptr || stopB == nullptr)
+			return;
+
+		memory::Scope memory_scope(memory::Subsystem::DISTANCE_TABLE);
+		stops_distance[std::pair<const Stop*, const Stop*> {stopA, stopB}] = distance;
+		distance_neighbours_[stopA].insert(stopB);
+		distance_neighbours_[stopB].insert(stopA);
+		UpdateSegmentDistances(stopA, stopB);
+		//the distance is used by segments from A to B and, when there is no distance from B to A, by segments back
+		for (const Bus* bus : FindAllBusesToStop(stopA)) {
+			route_ranking_.Invalidate(bus);
+		}
+		RecordStopChange(stopA);
+		++version_;
+	}
+
+	//Remove stop distance between A and B
+	bool TransportGuide::RemoveStopsDistance(const std::string& stop_name_A, const std::string& stop_name_B) {
 		auto stopA = FindStop(stop_name_A);
 		auto stopB = FindStop(stop_name_B);
 		if (stopA == nullptr || stopB == nullptr)
+			return false;
+
+		if (stops_distance.erase({ stopA, stopB }) == 0)
+			return false;
+
+		//Neighbours are kept while there is distance in any direction
+		if (stops_distance.count({ stopB, stopA }) == 0) {
+			distance_neighbours_[stopA].erase(stopB);
+			distance_neighbours_[stopB].erase(stopA);
+		}
+		UpdateSegmentDistances(stopA, stopB);
+		for (const Bus* bus : FindAllBusesToStop(stopA)) {
+			route_ranking_.Invalidate(bus);
+		}
+		RecordStopChange(stopA);
+		++version_;
+		return true;
+	}
+
+	void TransportGuide::RemoveStopDistances(const std::string& stop_name) {
+		const Stop* stop = FindStop(stop_name);
+		auto neighbours = distance_neighbours_.find(stop);
+		if (neighbours == distance_neighbours_.end())
 			return;
 
-		stops_distance[std::pair<const Stop*, const Stop*> {stopA, stopB}] = distance;
+		//removal changes the set of neighbours
+		const std::vector<const Stop*> others(neighbours->second.begin(), neighbours->second.end());
+		for (const Stop* other : others) {
+			RemoveStopsDistance(stop_name, other->name);
+		}
 	}
 
-	bool TransportGuide::HasStop(std::string name) const
+	bool TransportGuide::HasStop(const std::string& name) const
 	{
 		return name_to_stop_.count(name) != 0;
 	}
@@ -137,11 +417,41 @@ namespace tg {
 		return stops_;
 	}
 
-	Stops TransportGuide::GetStopsSharedPtrs() {
-		return stops_ptr_set_;
+	const Stops& TransportGuide::GetSortedStops() const {
+		return sorted_stops_;
 	}
 
-	Buses TransportGuide::GetBusesSharedPtrs() {
-		return buses_ptr_set_;
+	const Buses& TransportGuide::GetSortedBuses() const {
+		return sorted_buses_;
+	}
+
+	uint64_t TransportGuide::GetVersion() const {
+		return version_;
+	}
+
+	void TransportGuide::TrackChanges(CatalogueChanges* changes) {
+		changes_ = changes;
+	}
+
+	void TransportGuide::RecordStopChange(const Stop* stop) {
+		if (changes_ != nullptr) {
+			changes_->stops.insert(stop->name);
+		}
+	}
+
+	std::vector<const Bus*> TransportGuide::FindChangedBuses(const CatalogueChanges& changes) const {
+		StopBuses buses;
+		for (const std::string& name : changes.buses) {
+			if (const Bus* bus = FindBus(name)) {
+				buses.insert(bus);
+			}
+		}
+		for (const std::string& name : changes.stops) {
+			if (const Stop* stop = FindStop(name)) {
+				const StopBuses& stop_buses = FindAllBusesToStop(stop);
+				buses.insert(stop_buses.begin(), stop_buses.end());
+			}
+		}
+		return { buses.begin(), buses.end() };
 	}
 }
\ No newline at end of file
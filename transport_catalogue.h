@@ -9,10 +9,13 @@
 #include <vector>
 #include <iostream>
 #include <memory>
+#include <cstdint>
 
 
 #include "geo.h"
 #include "domain.h"
+#include "spatial_index.h"
+#include "route_ranking.h"
 
 using namespace tg::detail;
 
@@ -20,23 +23,75 @@ namespace tg {
 
 	class TransportGuide {
 
-		using NameToBus = std::unordered_map<std::string, Bus*>;
+		using NameToBus = std::unordered_map<std::string, std::list<Bus>::iterator>;
+		using NameToStop = std::unordered_map<std::string, std::list<Stop>::iterator>;
 	public:
+		//Adds bus, bus with the same name is replaced
 		void AddBus(std::string name, std::vector<std::string>& stops, bool isCircle);
 
+		//Same as above, stops must be already added to this guide
+		void AddBus(std::string name, std::vector<const Stop*> stops, bool isCircle);
+
+		//Adds stop, coordinates of the stop with the same name are updated
 		void AddStop(std::string name, Coordinates coordinates);
 
-		const Bus* FindBus(std::string name)const;
+		//Adds stop at (0, 0) that is named by a bus only, it isn't found by spatial queries
+		//till its coordinates are given by AddStop
+		void AddStopWithoutCoordinates(std::string name);
+
+		//Prepares indexes for the given number of stops
+		void ReserveStops(size_t count);
+
+		//Removes bus, returns false if there is no such bus
+		bool RemoveBus(const std::string& name);
+
+		//Removes stop and all distances from/to it.
+		//Returns false if there is no such stop or some bus still goes through it
+		bool RemoveStop(const std::string& name);
+
+		const Bus* FindBus(const std::string& name)const;
 
-		const Stop* FindStop(std::string name) const;
+		const Stop* FindStop(const std::string& name) const;
 
-		const std::unordered_set<Bus*> FindAllBusesToStop(const Stop* stop);
+		//Buses sorted by name, empty set if no bus goes through the stop
+		const StopBuses& FindAllBusesToStop(const Stop* stop) const;
 
-		bool IsStopDontHaveBuses(const std::shared_ptr<Stop> stop);
+		bool IsStopDontHaveBuses(const Stop* stop) const;
+
+		//Up to count stops closest to the point, sorted by distance
+		std::vector<StopDistance> FindNearestStops(Coordinates point, size_t count) const;
+
+		//Stops not further than radius meters from the point, sorted by distance
+		std::vector<StopDistance> FindStopsInRadius(Coordinates point, double radius) const;
+
+		//Stops inside the box, min is left bottom corner and max is right top one
+		std::vector<const Stop*> FindStopsInBox(Coordinates min, Coordinates max) const;
+
+		//For every bus crossing the box sorted indexes i of its segments GetStop(i) - GetStop(i + 1) that cross it
+		std::unordered_map<const Bus*, std::vector<size_t>> FindRouteSegmentsInBox(Coordinates min, Coordinates max) const;
 
 		int GetRealStopsDistance(const Stop* stopA, const Stop* stopB) const;
 
+		//Segment of Bus::segments, lengths are kept up to date with distances and coordinates
+		const RouteSegment& GetSegment(uint32_t id) const;
+
+		//Walks the route, distances and coordinates of its stops must be set
+		BusStatistics ComputeBusStatistics(const Bus* bus) const;
+
+		//Up to count buses with the longest routes, longest first
+		std::vector<RankedBus> GetLongestBuses(size_t count) const;
+		//Up to count buses with curvature greater than min_curvature, the most curved first
+		std::vector<RankedBus> FindBusesWithCurvatureAbove(double min_curvature, size_t count) const;
+		//Up to count stops served by the most buses
+		std::vector<RankedStop> GetBusiestStops(size_t count) const;
+
 		void SetStopsDistance(const std::string stop_name_A, const std::string stop_name_B, int distance);
+		void SetStopsDistance(const Stop* stopA, const Stop* stopB, int distance);
+
+		//Removes distance from A to B, returns false if it wasn't set
+		bool RemoveStopsDistance(const std::string& stop_name_A, const std::string& stop_name_B);
+		//Removes distances from the stop to all stops, distances to the stop are kept
+		void RemoveStopDistances(const std::string& stop_name);
 
 		class TwoStopHasher {
 		public:
@@ -51,25 +106,62 @@ namespace tg {
 		std::list<Stop> GetStops() ;
 		std::list<Bus> GetBuses() ;
 
-		Stops GetStopsSharedPtrs() ;
-		Buses GetBusesSharedPtrs() ;
+		const Stops& GetSortedStops() const;
+		const Buses& GetSortedBuses() const;
 
+		//Grows on every change of the catalogue, can be used to invalidate caches
+		uint64_t GetVersion() const;
 
-		bool HasStop(std::string name) const;
+		//Changes are recorded to changes till tracking is stopped by nullptr
+		void TrackChanges(CatalogueChanges* changes);
+		//Current buses of changes.buses and buses going through changes.stops, sorted by name
+		std::vector<const Bus*> FindChangedBuses(const CatalogueChanges& changes) const;
+
+		bool HasStop(const std::string& name) const;
 	private:
-		// key - name of the stop, value - ptr to Stop
-		std::unordered_map<std::string, Stop*> name_to_stop_;
-		//key - name of the bus, value - ptr to Bus
+		// key - name of the stop, value - position of the Stop in stops_
+		NameToStop name_to_stop_;
+		//key - name of the bus, value - position of the Bus in buses_
 		NameToBus name_to_route_;
 		// key - Stop, value - set of Buses
-		std::unordered_map<const Stop*, std::unordered_set<Bus*>> stop_to_routes_;
+		std::unordered_map<const Stop*, StopBuses> stop_to_routes_;
 		//key - two stops pair , value - distance
 		std::unordered_map<std::pair<const Stop*, const Stop*>, int, TwoStopHasher> stops_distance;
+		//deduplicated segments of all routes, ids of freed segments are reused
+		std::vector<RouteSegment> segments_;
+		std::vector<uint32_t> segment_references_;
+		std::vector<uint32_t> free_segments_;
+		std::unordered_map<std::pair<const Stop*, const Stop*>, uint32_t, TwoStopHasher> segment_ids_;
+		// key - Stop, value - stops that have distance set from/to it
+		std::unordered_map<const Stop*, std::unordered_set<const Stop*>> distance_neighbours_;
 		std::list<Stop> stops_;
 		std::list<Bus> buses_;
 
-		Stops stops_ptr_set_;
-		Buses buses_ptr_set_;
+		StopsIndex stops_index_;
+		//stops only named by buses, they are not in stops_index_
+		std::unordered_set<const Stop*> stops_without_coordinates_;
+		SegmentsIndex segments_index_;
+		//statistics of changed buses are counted by the next ranking query
+		mutable RouteRanking route_ranking_;
+
+		Stops sorted_stops_;
+		Buses sorted_buses_;
+
+		uint64_t version_ = 0;
+		size_t next_stop_id_ = 0;
+		CatalogueChanges* changes_ = nullptr;
+
+		//Enables the ranking on the first call and counts changed buses
+		void RefreshRanking() const;
+
+		void RecordStopChange(const Stop* stop);
+
+		//Id of the segment from A to B, the segment is added if routes didn't pass it yet
+		uint32_t AcquireSegment(const Stop* from, const Stop* to);
+		//The segment is freed when the last route passing it is removed
+		void ReleaseSegment(uint32_t id);
+		//Road distances of segments from A to B and from B to A are taken again
+		void UpdateSegmentDistances(const Stop* stopA, const Stop* stopB);
 
 		NameToBus GetNameToBus() {
 			return name_to_route_;
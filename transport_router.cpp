@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <unordered_set>
+
+#include "transport_router.h"
+
+namespace tg {
+
+	namespace {
+		const double INFINITE_TIME = std::numeric_limits<double>::infinity();
+		const TransportRouter::EdgeId NO_EDGE = std::numeric_limits<TransportRouter::EdgeId>::max();
+	}
+
+	TransportRouter::TransportRouter(const TransportGuide& guide, RoutingSettings settings)
+		: settings_(settings) {
+		for (const Stop* stop : guide.GetSortedStops()) {
+			AddStop(stop);
+		}
+		for (const Bus* bus : guide.GetSortedBuses()) {
+			AddBusEdges(guide, bus, nullptr);
+		}
+
+		if (settings_.use_contraction_hierarchy) {
+			BuildHierarchy(guide);
+		}
+	}
+
+	void TransportRouter::AddStop(const Stop* stop) {
+		if (stop->id >= stops_.size()) {
+			stops_.resize(stop->id + 1, nullptr);
+			edges_.resize(stops_.size() * 2);
+		}
+		stops_[stop->id] = stop;
+		if (edges_[GetWaitVertex(stop)].empty()) {
+			edges_[GetWaitVertex(stop)].push_back({ { GetRideVertex(stop), settings_.bus_wait_time }, nullptr, 0 });
+			++edge_count_;
+		}
+	}
+
+	void TransportRouter::AddBusEdges(const TransportGuide& guide, const Bus* bus, const Stop* only_from) {
+		//meters per minute
+		const double velocity = settings_.bus_velocity * 1000.0 / 60.0;
+		//every stop of [begin, end) of the whole route is connected with all next stops
+		auto add_edges = [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				const Stop* from = bus->GetStop(i);
+				if (only_from != nullptr && from != only_from) {
+					continue;
+				}
+				auto& edges = edges_[GetRideVertex(from)];
+				double distance = 0;
+				for (size_t j = i + 1; j < end; ++j) {
+					const Stop* to = bus->GetStop(j);
+					distance += guide.GetSegment(bus->segments[j - 1]).road_distance;
+					if (from == to) {
+						continue;
+					}
+					edges.push_back({ { GetWaitVertex(to), distance / velocity }, bus, static_cast<int>(j - i) });
+					++edge_count_;
+				}
+			}
+		};
+		if (bus->isCircle) {
+			add_edges(0, bus->stops.size());
+		}
+		else if (!bus->stops.empty()) {
+			//buses go back from the last stop, passengers don't ride through it
+			add_edges(0, bus->stops.size());
+			add_edges(bus->stops.size() - 1, bus->GetStopCount());
+		}
+	}
+
+	void TransportRouter::Update(const TransportGuide& guide, const CatalogueChanges& changes) {
+		//removed stops had no routes, so only their waiting is left
+		for (size_t id : changes.removed_stops) {
+			if (id < stops_.size() && stops_[id] != nullptr) {
+				edge_count_ -= edges_[id * 2].size();
+				edges_[id * 2].clear();
+				stops_[id] = nullptr;
+			}
+		}
+		//bus edges from a stop depend on the distances along the whole route after it
+		std::unordered_set<size_t> touched(changes.old_route_stops.begin(), changes.old_route_stops.end());
+		for (const std::string& name : changes.stops) {
+			if (const Stop* stop = guide.FindStop(name)) {
+				AddStop(stop);
+			}
+		}
+		for (const Bus* bus : guide.FindChangedBuses(changes)) {
+			for (const Stop* stop : bus->stops) {
+				touched.insert(stop->id);
+			}
+		}
+
+		for (size_t id : touched) {
+			if (id >= stops_.size()) {
+				continue;
+			}
+			auto& edges = edges_[id * 2 + 1];
+			edge_count_ -= edges.size();
+			edges.clear();
+			if (stops_[id] == nullptr) {
+				continue;
+			}
+			for (const Bus* bus : guide.FindAllBusesToStop(stops_[id])) {
+				AddBusEdges(guide, bus, stops_[id]);
+			}
+		}
+
+		//hierarchies of changed catalogues don't overwrite the saved one
+		settings_.hierarchy_file.clear();
+		hierarchy_.reset();
+	}
+
+	bool TransportRouter::IsHierarchyStale() const {
+		return settings_.use_contraction_hierarchy && !hierarchy_;
+	}
+
+	void TransportRouter::BuildHierarchy(const TransportGuide& guide) {
+		hierarchy_edges_.clear();
+		hierarchy_edge_infos_.clear();
+		//vertices of the stops are their ids, stops of routes get vertices after them
+		VertexId vertex_count = static_cast<VertexId>(GetVertexCount() / 2);
+		auto add_edge = [this](VertexId to, double weight, EdgeInfo info) {
+			hierarchy_edges_.push_back({ to, weight });
+			hierarchy_edge_infos_.push_back(info);
+		};
+
+		//meters per minute
+		const double velocity = settings_.bus_velocity * 1000.0 / 60.0;
+		for (const Bus* bus : guide.GetSortedBuses()) {
+			//passengers board at every stop of [begin, end) of the whole route and ride to the next one
+			auto add_chain = [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					const Stop* stop = bus->GetStop(i);
+					const VertexId vertex = vertex_count++;
+					const VertexId stop_vertex = static_cast<VertexId>(stop->id);
+					//waiting, getting off and riding from the previous stop
+					add_edge(vertex, settings_.bus_wait_time, { stop_vertex, stop, nullptr, 0 });
+					add_edge(stop_vertex, 0, { vertex, nullptr, bus, 0 });
+					if (i > begin) {
+						add_edge(vertex, guide.GetSegment(bus->segments[i - 1]).road_distance / velocity,
+							{ vertex - 1, nullptr, bus, 1 });
+					}
+				}
+			};
+			if (bus->isCircle) {
+				add_chain(0, bus->stops.size());
+			}
+			else if (!bus->stops.empty()) {
+				add_chain(0, bus->stops.size());
+				add_chain(bus->stops.size() - 1, bus->GetStopCount());
+			}
+		}
+
+		std::vector<ContractionHierarchy::InputEdge> input_edges(hierarchy_edges_.size());
+		for (EdgeId edge_id = 0; edge_id < hierarchy_edges_.size(); ++edge_id) {
+			input_edges[edge_id] = { hierarchy_edge_infos_[edge_id].from, hierarchy_edges_[edge_id].to,
+				hierarchy_edges_[edge_id].weight };
+		}
+		const uint64_t fingerprint = ContractionHierarchy::GetFingerprint(vertex_count, input_edges);
+		if (!settings_.hierarchy_file.empty()) {
+			std::ifstream input(settings_.hierarchy_file, std::ios::binary);
+			if (input) {
+				hierarchy_ = ContractionHierarchy::Load(input, fingerprint);
+			}
+		}
+		if (hierarchy_) {
+			return;
+		}
+		hierarchy_ = ContractionHierarchy::Build(vertex_count, input_edges);
+		if (!settings_.hierarchy_file.empty()) {
+			//failed saving only costs the preprocessing next time
+			std::ofstream output(settings_.hierarchy_file, std::ios::binary | std::ios::trunc);
+			hierarchy_->Save(output, fingerprint);
+		}
+	}
+
+	std::optional<Itinerary> TransportRouter::FindHierarchyRoute(const ContractionHierarchy& hierarchy,
+		const Stop* from, const Stop* to, Scratch& scratch) const {
+		auto path = hierarchy.FindPath(static_cast<VertexId>(from->id), static_cast<VertexId>(to->id), scratch.hierarchy_);
+		if (!path) {
+			return std::nullopt;
+		}
+		Itinerary itinerary;
+		itinerary.total_time = path->weight;
+		//rides between neighbour stops are joined up to the edge of getting off the bus
+		bool is_riding = false;
+		for (EdgeId edge_id : path->edges) {
+			const EdgeInfo& info = hierarchy_edge_infos_[edge_id];
+			if (info.stop != nullptr) {
+				itinerary.items.push_back({ info.stop, nullptr, 0, settings_.bus_wait_time });
+			}
+			else if (info.span_count == 0) {
+				is_riding = false;
+			}
+			else {
+				if (!is_riding) {
+					itinerary.items.push_back({ nullptr, info.bus, 0, 0 });
+					is_riding = true;
+				}
+				++itinerary.items.back().span_count;
+				itinerary.items.back().time += hierarchy_edges_[edge_id].weight;
+			}
+		}
+		return itinerary;
+	}
+
+	TransportRouter::VertexId TransportRouter::GetWaitVertex(const Stop* stop) {
+		return static_cast<VertexId>(stop->id * 2);
+	}
+
+	TransportRouter::VertexId TransportRouter::GetRideVertex(const Stop* stop) {
+		return static_cast<VertexId>(stop->id * 2 + 1);
+	}
+
+	void TransportRouter::ResetScratch(Scratch& scratch) const {
+		const size_t vertex_count = GetVertexCount();
+		if (scratch.distances_.size() != vertex_count) {
+			scratch.distances_.assign(vertex_count, INFINITE_TIME);
+			scratch.previous_vertices_.assign(vertex_count, 0);
+			scratch.previous_edges_.assign(vertex_count, NO_EDGE);
+			scratch.settled_.Resize(vertex_count);
+			scratch.touched_.clear();
+		}
+		for (VertexId vertex : scratch.touched_) {
+			scratch.distances_[vertex] = INFINITE_TIME;
+			scratch.previous_edges_[vertex] = NO_EDGE;
+			scratch.settled_.Reset(vertex);
+		}
+		scratch.touched_.clear();
+		scratch.heap_.clear();
+	}
+
+	void TransportRouter::Search(VertexId source, VertexId target, Scratch& scratch) const {
+		ResetScratch(scratch);
+
+		auto& heap = scratch.heap_;
+		const auto is_later = std::greater<std::pair<double, VertexId>>();
+		scratch.distances_[source] = 0;
+		scratch.touched_.push_back(source);
+		heap.push_back({ 0, source });
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), is_later);
+			const auto [distance, vertex] = heap.back();
+			heap.pop_back();
+			if (distance > scratch.distances_[vertex]) {
+				continue;
+			}
+			if (vertex == target) {
+				return;
+			}
+			const auto& edges = edges_[vertex];
+			for (EdgeId edge_id = 0; edge_id < edges.size(); ++edge_id) {
+				const Edge& edge = edges[edge_id].edge;
+				const double new_distance = distance + edge.weight;
+				if (new_distance < scratch.distances_[edge.to]) {
+					if (scratch.distances_[edge.to] == INFINITE_TIME) {
+						scratch.touched_.push_back(edge.to);
+					}
+					scratch.distances_[edge.to] = new_distance;
+					scratch.previous_vertices_[edge.to] = vertex;
+					scratch.previous_edges_[edge.to] = edge_id;
+					heap.push_back({ new_distance, edge.to });
+					std::push_heap(heap.begin(), heap.end(), is_later);
+				}
+			}
+		}
+	}
+
+	std::optional<Itinerary> TransportRouter::FindRoute(const Stop* from, const Stop* to) const {
+		return FindRoute(from, to, scratch_);
+	}
+
+	std::optional<Itinerary> TransportRouter::FindRoute(const Stop* from, const Stop* to, Scratch& scratch) const {
+		const VertexId source = GetWaitVertex(from);
+		const VertexId target = GetWaitVertex(to);
+		if (target >= GetVertexCount() || source >= GetVertexCount()) {
+			return std::nullopt;
+		}
+		if (hierarchy_) {
+			return FindHierarchyRoute(*hierarchy_, from, to, scratch);
+		}
+		Search(source, target, scratch);
+		if (scratch.distances_[target] == INFINITE_TIME) {
+			return std::nullopt;
+		}
+
+		Itinerary itinerary;
+		itinerary.total_time = scratch.distances_[target];
+		for (VertexId vertex = target; vertex != source; ) {
+			const VertexId previous = scratch.previous_vertices_[vertex];
+			const GraphEdge& edge = edges_[previous][scratch.previous_edges_[vertex]];
+			const Stop* stop = edge.bus == nullptr ? stops_[previous / 2] : nullptr;
+			itinerary.items.push_back({ stop, edge.bus, edge.span_count, edge.edge.weight });
+			vertex = previous;
+		}
+		std::reverse(itinerary.items.begin(), itinerary.items.end());
+		return itinerary;
+	}
+
+	std::vector<ReachedStop> TransportRouter::FindReachable(const std::vector<const Stop*>& from, double max_time) const {
+		return FindReachable(from, max_time, scratch_);
+	}
+
+	std::vector<ReachedStop> TransportRouter::FindReachable(const std::vector<const Stop*>& from, double max_time, Scratch& scratch) const {
+		ResetScratch(scratch);
+		auto& heap = scratch.heap_;
+		const auto is_later = std::greater<std::pair<double, VertexId>>();
+		for (const Stop* stop : from) {
+			const VertexId source = GetWaitVertex(stop);
+			if (source >= GetVertexCount() || scratch.distances_[source] == 0) {
+				continue;
+			}
+			scratch.distances_[source] = 0;
+			scratch.touched_.push_back(source);
+			heap.push_back({ 0, source });
+		}
+
+		//Dijkstra stops at the first vertex over the budget, the rest take longer
+		std::vector<ReachedStop> result;
+		while (!heap.empty()) {
+			std::pop_heap(heap.begin(), heap.end(), is_later);
+			const auto [time, vertex] = heap.back();
+			heap.pop_back();
+			if (time > max_time) {
+				break;
+			}
+			if (scratch.settled_.Test(vertex)) {
+				continue;
+			}
+			scratch.settled_.Set(vertex);
+			if (vertex % 2 == 0) {
+				result.push_back({ stops_[vertex / 2], time });
+			}
+			for (const GraphEdge& graph_edge : edges_[vertex]) {
+				const Edge& edge = graph_edge.edge;
+				const double new_time = time + edge.weight;
+				if (new_time < scratch.distances_[edge.to] && new_time <= max_time) {
+					if (scratch.distances_[edge.to] == INFINITE_TIME) {
+						scratch.touched_.push_back(edge.to);
+					}
+					scratch.distances_[edge.to] = new_time;
+					heap.push_back({ new_time, edge.to });
+					std::push_heap(heap.begin(), heap.end(), is_later);
+				}
+			}
+		}
+
+		//stops reached at equal time are ordered by name
+		std::sort(result.begin(), result.end(), [](const ReachedStop& lhs, const ReachedStop& rhs) {
+			return lhs.cost < rhs.cost || (lhs.cost == rhs.cost && lhs.stop->name < rhs.stop->name);
+		});
+		return result;
+	}
+
+	const RoutingSettings& TransportRouter::GetSettings() const {
+		return settings_;
+	}
+
+	size_t TransportRouter::GetVertexCount() const {
+		return edges_.size();
+	}
+
+	size_t TransportRouter::GetEdgeCount() const {
+		return edge_count_;
+	}
+
+	bool TransportRouter::HasHierarchy() const {
+		return hierarchy_.has_value();
+	}
+
+	size_t TransportRouter::GetShortcutCount() const {
+		return hierarchy_ ? hierarchy_->GetShortcutCount() : 0;
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "contraction_hierarchy.h"
+#include "dense_bitset.h"
+#include "domain.h"
+#include "transport_catalogue.h"
+
+namespace tg {
+
+	struct RoutingSettings {
+		//minutes
+		double bus_wait_time = 0;
+		//km/h
+		double bus_velocity = 0;
+		//queries go through the contraction hierarchy instead of plain Dijkstra once it is built
+		bool use_contraction_hierarchy = false;
+		//the hierarchy is loaded from the file if it was saved for the same graph, otherwise saved there when built
+		std::string hierarchy_file;
+	};
+
+	//Waiting at the stop if bus is nullptr, otherwise riding the bus for span_count stops
+	struct RouteItem {
+		const Stop* stop = nullptr;
+		const Bus* bus = nullptr;
+		int span_count = 0;
+		//minutes
+		double time = 0;
+	};
+
+	struct Itinerary {
+		double total_time = 0;
+		std::vector<RouteItem> items;
+	};
+
+	/*Every stop has two vertices: the passenger arrives to the wait vertex,
+	waits for a bus and gets to the ride vertex. Bus edges go from the ride vertex
+	of a stop to the wait vertices of all next stops of the route. Stop ids index
+	vertices and edges are kept per vertex, so changes of the catalogue only
+	collect edges of ride vertices of the changed routes again.
+	The contraction hierarchy is built over a sparser graph with the same
+	shortest paths: a vertex per stop and per stop of every route, passengers
+	wait to get from the stop to the route, ride to the next stop of the route
+	and get off for free. It is built or loaded with the router, so all Route
+	queries go through it and answers don't depend on timing. Contraction can't
+	follow changes of the graph, they drop the hierarchy till BuildHierarchy*/
+	class TransportRouter {
+	public:
+		using VertexId = uint32_t;
+		using EdgeId = uint32_t;
+
+		struct Edge {
+			VertexId to = 0;
+			//minutes
+			double weight = 0;
+		};
+
+		//Buffers of Dijkstra search, reused by the queries of one thread
+		class Scratch {
+		private:
+			friend class TransportRouter;
+			std::vector<double> distances_;
+			//the edge to the vertex is previous_edges_[v] of the edges of previous_vertices_[v]
+			std::vector<VertexId> previous_vertices_;
+			std::vector<EdgeId> previous_edges_;
+			//vertices with set distance, only they are cleared by the next query
+			std::vector<VertexId> touched_;
+			std::vector<std::pair<double, VertexId>> heap_;
+			DenseBitset settled_;
+			ContractionHierarchy::Scratch hierarchy_;
+		};
+
+		TransportRouter(const TransportGuide& guide, RoutingSettings settings);
+
+		//Edges of changed routes and stops are collected again, the hierarchy is dropped
+		//and the hierarchy file is not used any more
+		void Update(const TransportGuide& guide, const CatalogueChanges& changes);
+		//The hierarchy is turned on by the settings but dropped by Update
+		bool IsHierarchyStale() const;
+		//Builds the hierarchy graph, loads the hierarchy from the hierarchy file
+		//or builds it and saves it there
+		void BuildHierarchy(const TransportGuide& guide);
+
+		TransportRouter(const TransportRouter&) = delete;
+		TransportRouter& operator=(const TransportRouter&) = delete;
+
+		//Fastest itinerary, nullopt if to can't be reached. Uses internal scratch
+		std::optional<Itinerary> FindRoute(const Stop* from, const Stop* to) const;
+		std::optional<Itinerary> FindRoute(const Stop* from, const Stop* to, Scratch& scratch) const;
+		//Stops that can be reached from any of the sources in max_time minutes, sorted by time and name.
+		//Uses internal scratch
+		std::vector<ReachedStop> FindReachable(const std::vector<const Stop*>& from, double max_time) const;
+		std::vector<ReachedStop> FindReachable(const std::vector<const Stop*>& from, double max_time, Scratch& scratch) const;
+
+		const RoutingSettings& GetSettings() const;
+		size_t GetVertexCount() const;
+		size_t GetEdgeCount() const;
+		//Route queries are answered by the contraction hierarchy
+		bool HasHierarchy() const;
+		//zero without the contraction hierarchy
+		size_t GetShortcutCount() const;
+
+	private:
+		//Edge of the graph, waiting at the stop of the wait vertex if bus is nullptr
+		struct GraphEdge {
+			Edge edge;
+			const Bus* bus = nullptr;
+			int span_count = 0;
+		};
+
+		//What the edge of the hierarchy graph means for the passenger, stop is set
+		//for waiting and the bus edge of zero span_count is getting off
+		struct EdgeInfo {
+			VertexId from = 0;
+			const Stop* stop = nullptr;
+			const Bus* bus = nullptr;
+			int span_count = 0;
+		};
+
+		static VertexId GetWaitVertex(const Stop* stop);
+		static VertexId GetRideVertex(const Stop* stop);
+
+		//Wait vertex of the stop with its only edge
+		void AddStop(const Stop* stop);
+		//Edges of the bus from ride vertices of its stops, only of the stop if it is set
+		void AddBusEdges(const TransportGuide& guide, const Bus* bus, const Stop* only_from);
+		void ResetScratch(Scratch& scratch) const;
+		//Dijkstra from the vertex that stops as soon as target is settled
+		void Search(VertexId source, VertexId target, Scratch& scratch) const;
+		std::optional<Itinerary> FindHierarchyRoute(const ContractionHierarchy& hierarchy,
+			const Stop* from, const Stop* to, Scratch& scratch) const;
+
+		RoutingSettings settings_;
+		//by source vertex
+		std::vector<std::vector<GraphEdge>> edges_;
+		size_t edge_count_ = 0;
+		//by stop id, nullptr for removed stops
+		std::vector<const Stop*> stops_;
+		//edges of the hierarchy graph by their ids, from of the info is the source vertex
+		std::vector<Edge> hierarchy_edges_;
+		std::vector<EdgeInfo> hierarchy_edge_infos_;
+		std::optional<ContractionHierarchy> hierarchy_;
+		mutable Scratch scratch_;
+	};
+}